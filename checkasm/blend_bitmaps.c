@@ -30,9 +30,9 @@
 
 static void check_blend_bitmaps(BitmapBlendFunc func, const char *name)
 {
-    ALIGN(uint8_t src[SRC1_STRIDE * HEIGHT], 32);
-    ALIGN(uint8_t dst_ref[DST_STRIDE * HEIGHT], 32);
-    ALIGN(uint8_t dst_new[DST_STRIDE * HEIGHT], 32);
+    ALIGN(uint8_t src[SRC1_STRIDE * HEIGHT], 64);
+    ALIGN(uint8_t dst_ref[DST_STRIDE * HEIGHT], 64);
+    ALIGN(uint8_t dst_new[DST_STRIDE * HEIGHT], 64);
     declare_func(void,
                  uint8_t *dst, ptrdiff_t dst_stride,
                  const uint8_t *src, ptrdiff_t src_stride,
@@ -63,10 +63,10 @@ static void check_blend_bitmaps(BitmapBlendFunc func, const char *name)
 
 static void check_mul_bitmaps(BitmapMulFunc func)
 {
-    ALIGN(uint8_t src1[SRC1_STRIDE * HEIGHT], 32);
-    ALIGN(uint8_t src2[SRC2_STRIDE * HEIGHT], 32);
-    ALIGN(uint8_t dst_ref[DST_STRIDE * HEIGHT], 32);
-    ALIGN(uint8_t dst_new[DST_STRIDE * HEIGHT], 32);
+    ALIGN(uint8_t src1[SRC1_STRIDE * HEIGHT], 64);
+    ALIGN(uint8_t src2[SRC2_STRIDE * HEIGHT], 64);
+    ALIGN(uint8_t dst_ref[DST_STRIDE * HEIGHT], 64);
+    ALIGN(uint8_t dst_new[DST_STRIDE * HEIGHT], 64);
     declare_func(void,
                  uint8_t *dst, ptrdiff_t dst_stride,
                  const uint8_t *src1, ptrdiff_t src1_stride,
@@ -99,10 +99,101 @@ static void check_mul_bitmaps(BitmapMulFunc func)
     report("mul_bitmaps");
 }
 
+static void check_blend_rgba(BlendRGBAFunc func, const char *name)
+{
+    // unaligned destination with odd stride
+    uint8_t src[SRC1_STRIDE * HEIGHT];
+    uint8_t dst_ref[4 * DST_STRIDE * HEIGHT + 1];
+    uint8_t dst_new[4 * DST_STRIDE * HEIGHT + 1];
+    const ptrdiff_t dst_stride = 4 * DST_STRIDE - 3;
+    declare_func(void,
+                 uint8_t *dst, ptrdiff_t dst_stride,
+                 const uint8_t *src, ptrdiff_t src_stride,
+                 size_t width, size_t height, uint32_t color);
+
+    if (check_func(func, name)) {
+        for (int w = MIN_WIDTH; w < DST_STRIDE; w++) {
+            for (int i = 0; i < sizeof(src); i++) {
+                // favor the fully transparent and opaque values
+                unsigned r = rnd();
+                src[i] = r & 0x300 ? r : r & 0x400 ? 255 : 0;
+            }
+
+            for (int i = 0; i < sizeof(dst_ref); i++)
+                dst_ref[i] = dst_new[i] = rnd();
+
+            uint32_t color = rnd();
+            if (w % 3 == 1)
+                color |= 0xFF000000;
+
+            call_ref(dst_ref + 1, dst_stride, src, SRC1_STRIDE, w, HEIGHT, color);
+            call_new(dst_new + 1, dst_stride, src, SRC1_STRIDE, w, HEIGHT, color);
+
+            if (memcmp(dst_ref, dst_new, sizeof(dst_ref))) {
+                fail();
+                break;
+            }
+        }
+
+        bench_new(dst_new + 1, dst_stride, src, SRC1_STRIDE, DST_STRIDE - 1, HEIGHT, 0x80FFFFFF);
+    }
+
+    report(name);
+}
+
+static void check_blend_plane(BlendPlaneFunc func, const char *name, int bits)
+{
+    // unaligned destination with odd stride in samples
+    const int size = bits > 8 ? 2 : 1;
+    uint8_t src[SRC1_STRIDE * HEIGHT];
+    uint8_t dst_ref[2 * DST_STRIDE * HEIGHT + 2];
+    uint8_t dst_new[2 * DST_STRIDE * HEIGHT + 2];
+    const ptrdiff_t dst_stride = size * (DST_STRIDE - 1);
+    declare_func(void,
+                 uint8_t *dst, ptrdiff_t dst_stride,
+                 const uint8_t *src, ptrdiff_t src_stride,
+                 size_t width, size_t height, uint32_t color);
+
+    if (check_func(func, name)) {
+        for (int w = MIN_WIDTH; w < DST_STRIDE; w++) {
+            for (int i = 0; i < sizeof(src); i++) {
+                unsigned r = rnd();
+                src[i] = r & 0x300 ? r : r & 0x400 ? 255 : 0;
+            }
+
+            for (int i = 0; i < sizeof(dst_ref); i++)
+                dst_ref[i] = dst_new[i] = rnd();
+
+            // sample values must fit into the bit depth
+            uint32_t max = (1 << bits) - 1, color = rnd();
+            color = (color & 0xFF000000) |
+                (((color >> 12) & max) << 12) | (color & max);
+            if (w % 3 == 1)
+                color |= 0xFF000000;
+
+            call_ref(dst_ref + size, dst_stride, src, SRC1_STRIDE, w, HEIGHT, color);
+            call_new(dst_new + size, dst_stride, src, SRC1_STRIDE, w, HEIGHT, color);
+
+            if (memcmp(dst_ref, dst_new, sizeof(dst_ref))) {
+                fail();
+                break;
+            }
+        }
+
+        bench_new(dst_new + size, dst_stride, src, SRC1_STRIDE, DST_STRIDE - 1, HEIGHT, 0x80080080);
+    }
+
+    report(name);
+}
+
 void checkasm_check_blend_bitmaps(unsigned cpu_flag)
 {
     BitmapEngine engine = ass_bitmap_engine_init(cpu_flag);
     check_blend_bitmaps(engine.add_bitmaps, "add_bitmaps");
     check_blend_bitmaps(engine.imul_bitmaps, "imul_bitmaps");
     check_mul_bitmaps(engine.mul_bitmaps);
+    check_blend_rgba(engine.blend_rgba, "blend_rgba");
+    check_blend_rgba(engine.blend_rgba_straight, "blend_rgba_straight");
+    check_blend_plane(engine.blend_plane8, "blend_plane8", 8);
+    check_blend_plane(engine.blend_plane10, "blend_plane10", 10);
 }
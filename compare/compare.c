@@ -32,6 +32,10 @@
 #define FFMAX(a,b) ((a) > (b) ? (a) : (b))
 #define FFMIN(a,b) ((a) > (b) ? (b) : (a))
 
+#define MAX_THREADS 64
+#define MAX_FRAMES 100
+#define FRAME_DURATION 40  // warm-up frame interval in milliseconds
+
 static void blend_image(Image8 *frame, int32_t x0, int32_t y0,
                         const ASS_Image *img)
 {
@@ -324,7 +328,7 @@ Result classify_result(double error)
 static Result process_image(ASS_Renderer *renderer, ASS_Track *track,
                             const char *input, const char *output,
                             const char *file, int64_t time,
-                            int scale_x, int scale_y)
+                            int scale_x, int scale_y, int frames)
 {
     uint64_t tm = time;
     unsigned msec = tm % 1000;  tm /= 1000;
@@ -351,6 +355,10 @@ static Result process_image(ASS_Renderer *renderer, ASS_Track *track,
 
     ass_set_storage_size(renderer, target.width, target.height);
     ass_set_frame_size(renderer, scale_x * target.width, scale_y * target.height);
+    // preceding frames fill the caches that carry over between frames
+    for (int i = frames; i > 0; i--)
+        if (time >= (int64_t) i * FRAME_DURATION)
+            ass_render_frame(renderer, track, time - i * FRAME_DURATION, NULL);
     ASS_Image *img = ass_render_frame(renderer, track, time, NULL);
 
     const char *out_file = NULL;
@@ -536,7 +544,7 @@ static bool process_input(ItemList *list, const char *path, ASS_Library *lib)
 
 
 enum {
-    OUTPUT, SCALE, LEVEL, INPUT
+    OUTPUT, SCALE, LEVEL, THREADS, FRAMES, INPUT
 };
 
 static int *parse_cmdline(int argc, char *argv[])
@@ -558,6 +566,8 @@ static int *parse_cmdline(int argc, char *argv[])
         case 'o':  index = OUTPUT;   break;
         case 's':  index = SCALE;    break;
         case 'p':  index = LEVEL;    break;
+        case 't':  index = THREADS;  break;
+        case 'f':  index = FRAMES;   break;
         default:   goto fail;
         }
         if (argv[i][2] || ++i >= argc || pos[index])
@@ -571,6 +581,7 @@ fail:
     free(pos);
     const char *fmt =
         "Usage: %s ([-i] <input-dir>)+ [-o <output-dir>] [-s <scale:1-8>[x<scale:1-8>]] [-p <pass-level:0-3>]\n"
+        "          [-t <threads:1-64>] [-f <frames:0-100>]\n"
         "\n"
         "Scale can be a single uniform scaling factor or a pair of independent horizontal and vertical factors. -s N is equivalent to -s NxN.\n";
     printf(fmt, argv[0] ? argv[0] : "compare");
@@ -590,6 +601,22 @@ static bool parse_scale(const char *arg,  int *scale_x, int *scale_y)
     return true;
 }
 
+static bool parse_number(const char *arg, int min, int max, int *value)
+{
+    int res = 0;
+    do {
+        if (*arg < '0' || *arg > '9')
+            return false;
+        res = 10 * res + (*arg - '0');
+        if (res > max)
+            return false;
+    } while (*++arg);
+    if (res < min)
+        return false;
+    *value = res;
+    return true;
+}
+
 void msg_callback(int level, const char *fmt, va_list va, void *data)
 {
     if (level > 3)
@@ -625,6 +652,18 @@ int main(int argc, char *argv[])
         level = arg[0] - '0';
     }
 
+    int threads = 1;
+    if (pos[THREADS] && !parse_number(argv[pos[THREADS]], 1, MAX_THREADS, &threads)) {
+        printf("Invalid thread count, should be 1-%d!\n", MAX_THREADS);
+        goto end;
+    }
+
+    int frames = 0;
+    if (pos[FRAMES] && !parse_number(argv[pos[FRAMES]], 0, MAX_FRAMES, &frames)) {
+        printf("Invalid frame count, should be 0-%d!\n", MAX_FRAMES);
+        goto end;
+    }
+
     const char *output = NULL;
     if (pos[OUTPUT]) {
         output = argv[pos[OUTPUT]];
@@ -659,6 +698,8 @@ int main(int argc, char *argv[])
         goto end;
     }
     ass_set_fonts(renderer, NULL, NULL, ASS_FONTPROVIDER_NONE, NULL, 0);
+    if (threads > 1 && ass_set_threads(renderer, threads) != threads)
+        printf("Rendering with fewer threads than requested.\n");
 
     result = 0;
     size_t prefix = 0;
@@ -693,7 +734,7 @@ int main(int argc, char *argv[])
             continue;
         Result res = process_image(renderer, track, list.items[i].dir, output,
                                    name, list.items[i].time,
-                                   scale_x, scale_y);
+                                   scale_x, scale_y, frames);
         result = FFMAX(result, res);
         if (res <= level)
             good++;
@@ -75,6 +75,7 @@ void ass_free_track(ASS_Track *track)
         free(track->parser_priv->read_order_bitmap);
         free(track->parser_priv->fontname);
         free(track->parser_priv->fontdata);
+        ass_event_index_done(&track->parser_priv->event_index);
         free(track->parser_priv);
     }
     free(track->style_format);
@@ -1371,6 +1372,7 @@ void ass_flush_events(ASS_Track *track)
             ass_free_event(track, eid);
         track->n_events = 0;
     }
+    ass_event_index_reset(&track->parser_priv->event_index);
     free(track->parser_priv->read_order_bitmap);
     track->parser_priv->read_order_bitmap = NULL;
     track->parser_priv->read_order_elems = 0;
@@ -1414,6 +1416,7 @@ void ass_prune_events(ASS_Track *track, long long deadline)
         }
     }
     track->n_events = n_kept;
+    ass_event_index_prune(&track->parser_priv->event_index, deadline);
 }
 
 #ifdef CONFIG_ICONV
@@ -1713,16 +1716,14 @@ int ass_read_styles(ASS_Track *track, const char *fname, const char *codepage)
     return 0;
 }
 
-long long ass_step_sub(ASS_Track *track, long long now, int movement)
+// Fallback for when the event index cannot be allocated
+static long long step_sub_scan(ASS_Track *track, long long now, int movement)
 {
     int i;
     ASS_Event *best = NULL;
     long long target = now;
     int direction = (movement > 0 ? 1 : -1) * !!movement;
 
-    if (track->n_events == 0)
-        return 0;
-
     do {
         ASS_Event *closest = NULL;
         long long closest_time = now;
@@ -1763,6 +1764,62 @@ long long ass_step_sub(ASS_Track *track, long long now, int movement)
     return best ? best->Start - now : 0;
 }
 
+long long ass_step_sub(ASS_Track *track, long long now, int movement)
+{
+    bool found = false;
+    long long best_start = 0;
+    long long target = now;
+    int direction = (movement > 0 ? 1 : -1) * !!movement;
+
+    if (track->n_events == 0)
+        return 0;
+
+    EventIndex *index = &track->parser_priv->event_index;
+    if (!ass_event_index_update(index, track))
+        return step_sub_scan(track, now, movement);
+
+    do {
+        long long closest_time = now, start;
+        if (direction < 0) {
+            const EventSpan *closest = ass_event_index_last_end(index, target);
+            if (closest) {
+                closest_time = closest->end;
+                best_start = closest->start;
+                found = true;
+            }
+        } else if (direction > 0 ?
+                ass_event_index_next_start(index, target, &start) :
+                ass_event_index_prev_start(index, target, &start)) {
+            closest_time = best_start = start;
+            found = true;
+        }
+        target = closest_time + direction;
+        movement -= direction;
+    } while (movement);
+
+    return found ? best_start - now : 0;
+}
+
+long long ass_next_event_change(ASS_Track *track, long long now)
+{
+    EventIndex *index = &track->parser_priv->event_index;
+    if (ass_event_index_update(index, track))
+        return ass_event_index_next_change(index, now);
+
+    long long next = LLONG_MAX;
+    for (int i = 0; i < track->n_events; i++) {
+        long long start = track->events[i].Start;
+        long long end = start + track->events[i].Duration;
+        if (start >= end)
+            continue;
+        if (start > now)
+            next = FFMIN(next, start);
+        else if (end > now)
+            next = FFMIN(next, end);
+    }
+    return next;
+}
+
 ASS_Track *ass_new_track(ASS_Library *library)
 {
     int def_sid = -1;
@@ -24,7 +24,7 @@
 #include <stdarg.h>
 #include "ass_types.h"
 
-#define LIBASS_VERSION 0x01704000
+#define LIBASS_VERSION 0x01704002
 
 #ifdef __cplusplus
 extern "C" {
@@ -119,6 +119,124 @@ typedef enum {
     ASS_SHAPING_COMPLEX
 } ASS_ShapingLevel;
 
+/**
+ * \brief Rasterizer tile sizes.
+ *
+ * SMALL uses 16x16 tiles and gives the best quality.
+ * LARGE uses 32x32 tiles, which is faster for large outlines
+ * at the cost of slightly worse quality.
+ * AUTO picks small tiles for text and large tiles for big drawings.
+ *
+ * The default is SMALL unless libass was built with large tiles enabled.
+ */
+typedef enum {
+    ASS_TILES_SMALL = 0,
+    ASS_TILES_LARGE,
+    ASS_TILES_AUTO
+} ASS_TileSize;
+
+/**
+ * \brief Cache eviction policies.
+ *
+ * LRU evicts the least recently used items first.
+ * SLRU (segmented LRU) additionally protects items that have been reused
+ * at least once: items used only once are evicted before them, so that
+ * a scene with many unique items does not flush the regular working set.
+ */
+typedef enum {
+    ASS_CACHE_POLICY_LRU = 0,
+    ASS_CACHE_POLICY_SLRU
+} ASS_CachePolicy;
+
+/**
+ * \brief Runtime statistics of a single cache, see ass_get_cache_stats().
+ *
+ * Every lookup is either a hit or a miss. A miss results in a construction
+ * unless the item could not be allocated. Evictions count items removed
+ * to stay within the cache limits; clearing caches is not counted.
+ */
+typedef struct ass_cache_counters {
+    unsigned long long lookups;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long constructions;
+    unsigned long long evictions;
+    size_t bytes;                   // approximate current memory use
+    size_t items;                   // current number of items
+    long long construct_time;       // total construction time in nanoseconds
+} ASS_CacheCounters;
+
+/**
+ * \brief Statistics of all caches of a renderer.
+ */
+typedef struct ass_cache_stats {
+    ASS_CacheCounters font;
+    ASS_CacheCounters outline;
+    ASS_CacheCounters glyph_metrics;
+    ASS_CacheCounters face_size_metrics;
+    ASS_CacheCounters bitmap;
+    ASS_CacheCounters composite;
+} ASS_CacheStats;
+
+/**
+ * \brief Pixel format and alpha mode of ass_blend_frame_rgba().
+ * The frame holds 4 bytes per pixel, in R, G, B, A order by default.
+ */
+typedef enum {
+    ASS_BLEND_PREMULTIPLIED = 0,    // color channels premultiplied by alpha
+    ASS_BLEND_STRAIGHT      = 1 << 0,   // color channels not premultiplied
+    ASS_BLEND_BGRA          = 1 << 1,   // B, G, R, A byte order
+} ASS_BlendFlags;
+
+/**
+ * \brief Planar YCbCr formats of ass_blend_frame_yuv(), all with chroma
+ * subsampled by 2 in both directions.
+ */
+typedef enum {
+    ASS_YUV_I420,   // 8-bit Y, U and V planes
+    ASS_YUV_NV12,   // 8-bit Y plane and interleaved UV plane
+    ASS_YUV_P010,   // as NV12 with 16-bit samples in native byte order,
+                    // holding 10-bit values in the highest bits
+} ASS_YUVFormat;
+
+/**
+ * \brief Screen rectangle, see ass_get_dirty_rects().
+ */
+typedef struct ass_dirty_rect {
+    int x, y;                       // top-left corner inside the video frame
+    int w, h;
+} ASS_DirtyRect;
+
+/**
+ * \brief Placement of a single image of an ASS_Atlas.
+ */
+typedef struct ass_atlas_rect {
+    int atlas_x, atlas_y;           // top-left corner of the bitmap in the atlas
+    int w, h;                       // bitmap size
+    int dst_x, dst_y;               // bitmap placement inside the video frame
+    uint32_t color;                 // RGBA, as in ASS_Image
+    int type;                       // ASS_Image type
+} ASS_AtlasRect;
+
+/**
+ * \brief Frame images packed into a single buffer, see ass_render_frame_atlas().
+ * Images of consecutive frames with the same bitmaps keep their place,
+ * so only the updated parts of the atlas need to be uploaded.
+ */
+typedef struct ass_atlas {
+    unsigned char *buffer;          // 1bpp alpha values of all bitmaps
+    int w, h;                       // atlas size
+    int stride;
+
+    const ASS_AtlasRect *rects;     // one per image, in blending order
+    int n_rects;
+
+    // Parts of the atlas written since the previous frame. A single rectangle
+    // covers the whole atlas when it has been repacked, e.g. after resizing.
+    const ASS_DirtyRect *updated;
+    int n_updated;
+} ASS_Atlas;
+
 /**
  * \brief Style override options. See
  * ass_set_selective_style_override_enabled() for details.
@@ -509,6 +627,27 @@ void ass_set_font_scale(ASS_Renderer *priv, double font_scale);
  */
 void ass_set_hinting(ASS_Renderer *priv, ASS_Hinting ht);
 
+/**
+ * \brief Set the tile size used by the rasterizer.
+ * \param priv renderer handle
+ * \param tiles tile size selection
+ */
+void ass_set_tile_size(ASS_Renderer *priv, ASS_TileSize tiles);
+
+/**
+ * \brief Approximate the subpixel positions of moving events.
+ * Events that only move (\\move, Banner and Scroll effects) are then
+ * rendered at whole pixel positions and shifted by the remaining fraction
+ * of a pixel with interpolation, so their glyphs and composites are reused
+ * from frame to frame instead of being rasterized again.
+ * This changes the output: edges and borders of such events become
+ * slightly softer than with regular subpixel rasterization.
+ * Events with an explicit \\org are never approximated.
+ * \param priv renderer handle
+ * \param approximate whether to approximate, disabled by default
+ */
+void ass_set_approximate_moves(ASS_Renderer *priv, int approximate);
+
 /**
  * \brief Set line spacing. Will not be scaled with frame size.
  * \param priv renderer handle
@@ -606,6 +745,93 @@ int ass_fonts_update(ASS_Renderer *priv);
 void ass_set_cache_limits(ASS_Renderer *priv, int glyph_max,
                           int bitmap_max_size);
 
+/**
+ * \brief Set the eviction policy of the glyph and bitmap caches.
+ * The default is ASS_CACHE_POLICY_LRU.
+ *
+ * \param priv renderer handle
+ * \param policy eviction policy; unknown values select the default
+ */
+void ass_set_cache_policy(ASS_Renderer *priv, ASS_CachePolicy policy);
+
+/**
+ * \brief Enable timeline-aware eviction of the bitmap caches.
+ * Cached bitmaps are associated with the events they were rendered for.
+ * When the caches have to be cut, bitmaps used only by events that are
+ * neither displayed at the current time nor start within the lookahead
+ * window after it are evicted first; the regular policy applies after that.
+ *
+ * \param priv renderer handle
+ * \param lookahead length of the window in milliseconds;
+ * negative values (the default) disable timeline-aware eviction
+ */
+void ass_set_cache_lookahead(ASS_Renderer *priv, long long lookahead);
+
+/**
+ * \brief Get runtime statistics of the renderer caches.
+ * Counters are cumulative over the lifetime of the renderer.
+ * Must not be called concurrently with ass_render_frame().
+ *
+ * \param priv renderer handle
+ * \param stats output, filled completely
+ */
+void ass_get_cache_stats(ASS_Renderer *priv, ASS_CacheStats *stats);
+
+/**
+ * \brief Set a single memory budget covering all renderer caches.
+ * When set, it replaces the limits of ass_set_cache_limits(). If the caches
+ * exceed the budget, the budget is divided among them by how expensive
+ * their items are to recreate, so that cheap items are evicted first.
+ * Memory use is approximate: font data and other memory shared between
+ * cache items is not accounted.
+ *
+ * \param priv renderer handle
+ * \param max_bytes budget in bytes; 0 (the default) disables it
+ */
+void ass_set_cache_budget(ASS_Renderer *priv, size_t max_bytes);
+
+/**
+ * \brief Get the approximate memory use of all renderer caches.
+ *
+ * \param priv renderer handle
+ * \return size in bytes, as accounted by ass_set_cache_budget()
+ */
+size_t ass_get_cache_size(ASS_Renderer *priv);
+
+/**
+ * \brief Use a persistent cache file for glyph outlines and bitmaps.
+ * Outlines and bitmaps found in the file are used instead of being
+ * rendered again; newly rendered ones are added to the file when the
+ * renderer is destroyed or the cache file is changed. Glyphs already
+ * held by the in-memory caches when the file is set are not added.
+ * The file may be shared by any number of processes: it is replaced
+ * atomically, and files written by another libass or FreeType version
+ * are ignored.
+ * Fonts are identified by their contents, not by file name.
+ * Must not be called concurrently with ass_render_frame().
+ *
+ * \param priv renderer handle
+ * \param path cache file name; NULL to stop using a cache file.
+ * Passing the current file name writes out new contents immediately.
+ * \return 1 on success, 0 on failure (the previous file was not saved
+ * or there was not enough memory)
+ */
+int ass_set_disk_cache(ASS_Renderer *priv, const char *path);
+
+/**
+ * \brief Set the number of threads used for rendering.
+ * Events displayed in the same frame are then rendered in parallel by
+ * ass_render_frame(); the output is identical to single-threaded rendering.
+ * Must not be called concurrently with ass_render_frame().
+ *
+ * \param priv renderer handle
+ * \param threads total number of rendering threads including the caller;
+ * 1 (the default) disables multithreading, 0 uses one thread per CPU
+ * \return number of threads actually in use; this is 1 if libass
+ * was built without threading support or threads could not be started
+ */
+int ass_set_threads(ASS_Renderer *priv, int threads);
+
 /**
  * \brief Render a frame, producing a list of ASS_Image.
  * \param priv renderer handle
@@ -617,6 +843,84 @@ void ass_set_cache_limits(ASS_Renderer *priv, int glyph_max,
 ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
                             long long now, int *detect_change);
 
+/**
+ * \brief Render a frame, producing images packed into a single atlas.
+ * Same as ass_render_frame(), but the images are copied into an atlas kept
+ * by the renderer. Areas of the atlas not covered by any rectangle
+ * have unspecified contents.
+ *
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \param detect_change see ass_render_frame()
+ * \return atlas owned by the renderer, valid until the next call to
+ * ass_render_frame() or ass_render_frame_atlas(); NULL on allocation
+ * failure, the next frame is packed from scratch then
+ */
+const ASS_Atlas *ass_render_frame_atlas(ASS_Renderer *priv, ASS_Track *track,
+                                        long long now, int *detect_change);
+
+/**
+ * \brief Get the regions changed by the last call to ass_render_frame().
+ * Pixels outside of the returned rectangles are identical when blending
+ * the previous and the current image list; the rectangles do not overlap.
+ * The first frame is compared to an empty image list, as is the frame
+ * after a call to ass_render_frame() that returned NULL.
+ * The regions are computed by the first call after each frame, renderers
+ * that never call this function don't pay for the comparison.
+ *
+ * \param priv renderer handle
+ * \param rects set to an array of rectangles owned by the renderer,
+ * valid until the next call to ass_render_frame()
+ * \return number of rectangles, 0 if nothing has changed
+ */
+int ass_get_dirty_rects(ASS_Renderer *priv, const ASS_DirtyRect **rects);
+
+/**
+ * \brief Blend an image list over a frame with 8-bit RGBA pixels.
+ * Images are blended in list order with their colors taken as is;
+ * parts outside of the frame are skipped.
+ *
+ * \param priv renderer handle
+ * \param images image list, e.g. returned by ass_render_frame()
+ * \param frame pointer to the top-left pixel of the frame
+ * \param stride frame stride in bytes
+ * \param width frame width in pixels
+ * \param height frame height in pixels
+ * \param flags combination of ASS_BlendFlags
+ */
+void ass_blend_frame_rgba(ASS_Renderer *priv, const ASS_Image *images,
+                          unsigned char *frame, int stride,
+                          int width, int height, int flags);
+
+/**
+ * \brief Blend an image list over a planar YCbCr frame.
+ * Image colors are converted with the matrix of the track's YCbCr Matrix
+ * header, or with the video matrix if the header is "None". A missing
+ * or invalid header selects BT.601 TV range, as does a video matrix
+ * of YCBCR_DEFAULT, YCBCR_UNKNOWN or YCBCR_NONE.
+ * Chroma samples take the average coverage of their 2x2 block of pixels.
+ *
+ * \param priv renderer handle
+ * \param track subtitle track the images were rendered from, may be NULL
+ * to always use the video matrix
+ * \param images image list, e.g. returned by ass_render_frame()
+ * \param format layout of the frame planes
+ * \param video_matrix YCbCr matrix of the video
+ * \param planes pointers to the top-left samples of the Y plane
+ * and of the U and V planes (I420) or the UV plane (others)
+ * \param strides plane strides in bytes
+ * \param width frame width in pixels
+ * \param height frame height in pixels
+ * \return 1 on success, 0 on allocation failure leaving
+ * the frame partially blended
+ */
+int ass_blend_frame_yuv(ASS_Renderer *priv, ASS_Track *track,
+                        const ASS_Image *images, ASS_YUVFormat format,
+                        ASS_YCbCrMatrix video_matrix,
+                        unsigned char *const planes[3], const int strides[3],
+                        int width, int height);
+
 
 /*
  * The following functions operate on track objects and do not need
@@ -832,6 +1136,17 @@ void ass_clear_fonts(ASS_Library *library);
  */
 long long ass_step_sub(ASS_Track *track, long long now, int movement);
 
+/**
+ * \brief Find the next time at which the set of displayed events changes.
+ * Until then ass_render_frame() produces the same events, so callers can
+ * skip rendering between changes if no event is animated.
+ * \param track subtitle track
+ * \param now current time in milliseconds
+ * \return time of the next change in milliseconds,
+ * or LLONG_MAX if the displayed events never change after now
+ */
+long long ass_next_event_change(ASS_Track *track, long long now);
+
 /**
  * \brief Allocates memory that can be safely freed by libass later.
  * Use this to allocate buffers you'll use to manually modify ASS_Track events
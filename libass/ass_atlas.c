@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass_atlas.h"
+#include "ass_render.h"
+#include "ass_utils.h"
+
+#define ATLAS_MIN_HEIGHT 256
+#define ATLAS_WIDTH_ALIGN 16
+#define SHELF_HEIGHT_ALIGN 4
+
+struct atlas_slot {
+    const unsigned char *bitmap;
+    int w, h, stride;
+    int x, y;
+    int shelf;
+    bool fresh;                 // placed during this update
+};
+
+struct atlas_shelf {
+    int y, h;
+    int end;                    // left edge of the free space
+    int n_slots;
+};
+
+struct atlas_ref {
+    const ASS_Image *img;
+    int index;                  // position in the image list
+    int slot;
+};
+
+static void reset_atlas(Atlas *atlas)
+{
+    ass_frame_unref(atlas->images);
+    atlas->images = NULL;
+    free(atlas->out.buffer);
+    atlas->out = (ASS_Atlas) {0};
+    atlas->n_slots = atlas->n_shelves = 0;
+}
+
+void ass_atlas_done(Atlas *atlas)
+{
+    reset_atlas(atlas);
+    free(atlas->slots);
+    free(atlas->new_slots);
+    free(atlas->shelves);
+    free(atlas->refs);
+    free(atlas->rects);
+    free(atlas->updated);
+    memset(atlas, 0, sizeof(*atlas));
+}
+
+static int cmp_slot(const void *a, const void *b)
+{
+    const AtlasSlot *sa = a, *sb = b;
+    if (sa->bitmap != sb->bitmap)
+        return (uintptr_t) sa->bitmap < (uintptr_t) sb->bitmap ? -1 : 1;
+    if (sa->w != sb->w)
+        return sa->w - sb->w;
+    if (sa->h != sb->h)
+        return sa->h - sb->h;
+    return sa->stride - sb->stride;
+}
+
+static AtlasSlot image_key(const ASS_Image *img)
+{
+    return (AtlasSlot) {
+        .bitmap = img->bitmap, .w = img->w, .h = img->h, .stride = img->stride
+    };
+}
+
+static int cmp_slot_image(const AtlasSlot *slot, const ASS_Image *img)
+{
+    AtlasSlot key = image_key(img);
+    return cmp_slot(slot, &key);
+}
+
+static int cmp_ref(const void *a, const void *b)
+{
+    const AtlasRef *ra = a, *rb = b;
+    AtlasSlot key = image_key(ra->img);
+    int res = cmp_slot_image(&key, rb->img);
+    if (res)
+        return res;
+    return ra->index - rb->index;
+}
+
+// tallest first, which makes the shelves of a fresh packing tight
+static int cmp_slot_height(const void *a, const void *b)
+{
+    const AtlasSlot *sa = a, *sb = b;
+    if (sa->h != sb->h)
+        return sb->h - sa->h;
+    return cmp_slot(a, b);
+}
+
+static void release_slot(Atlas *atlas, const AtlasSlot *slot)
+{
+    AtlasShelf *shelf = atlas->shelves + slot->shelf;
+    if (!--shelf->n_slots)
+        shelf->end = 0;
+}
+
+/**
+ * \brief Find space for a slot on a shelf of a similar height,
+ * opening a new shelf at the bottom if there is none.
+ * Enough shelves must have been allocated beforehand.
+ * \return false if the slot does not fit into the given height
+ */
+static bool place_slot(Atlas *atlas, AtlasSlot *slot, int width, int height)
+{
+    int w = slot->w, h = slot->h;
+    if (w > width)
+        return false;
+
+    AtlasShelf *best = NULL;
+    for (int i = 0; i < atlas->n_shelves; i++) {
+        AtlasShelf *shelf = atlas->shelves + i;
+        if (shelf->h < h || shelf->h > h + h / 2 + SHELF_HEIGHT_ALIGN)
+            continue;
+        if (width - shelf->end < w)
+            continue;
+        if (!best || shelf->h < best->h)
+            best = shelf;
+    }
+
+    if (!best) {
+        int y = 0;
+        if (atlas->n_shelves) {
+            AtlasShelf *last = atlas->shelves + atlas->n_shelves - 1;
+            y = last->y + last->h;
+        }
+        int shelf_h = ass_align(SHELF_HEIGHT_ALIGN, h);
+        if (shelf_h > height - y)
+            return false;
+        best = atlas->shelves + atlas->n_shelves++;
+        best->y = y;
+        best->h = shelf_h;
+        best->end = 0;
+        best->n_slots = 0;
+    }
+
+    slot->x = best->end;
+    slot->y = best->y;
+    slot->shelf = best - atlas->shelves;
+    slot->fresh = true;
+    best->end += w;
+    best->n_slots++;
+    return true;
+}
+
+/**
+ * \brief Place all slots from scratch, doubling the atlas height
+ * until everything fits, and reallocate the buffer if needed
+ */
+static bool repack(Atlas *atlas, AtlasSlot *slots, int n_slots, int width)
+{
+    qsort(slots, n_slots, sizeof(AtlasSlot), cmp_slot_height);
+
+    int height = ATLAS_MIN_HEIGHT;
+    while (true) {
+        atlas->n_shelves = 0;
+        int i;
+        for (i = 0; i < n_slots; i++)
+            if (!place_slot(atlas, slots + i, width, height))
+                break;
+        if (i == n_slots)
+            break;
+        if (height > INT_MAX / 2 / width)
+            return false;
+        height *= 2;
+    }
+
+    qsort(slots, n_slots, sizeof(AtlasSlot), cmp_slot);
+
+    if (width != atlas->out.w || height != atlas->out.h) {
+        free(atlas->out.buffer);
+        atlas->out.buffer = calloc((size_t) width, height);
+        if (!atlas->out.buffer)
+            return false;
+        atlas->out.w = atlas->out.stride = width;
+        atlas->out.h = height;
+    }
+
+    atlas->updated[0] = (ASS_DirtyRect) { 0, 0, width, height };
+    atlas->out.n_updated = 1;
+    return true;
+}
+
+static bool alloc_buffers(Atlas *atlas, int n)
+{
+    if (n > atlas->max_images) {
+        int new_max = FFMAX(n, 2 * atlas->max_images);
+        if (!ASS_REALLOC_ARRAY(atlas->refs, new_max) ||
+                !ASS_REALLOC_ARRAY(atlas->rects, new_max) ||
+                !ASS_REALLOC_ARRAY(atlas->updated, new_max))
+            return false;
+        atlas->max_images = new_max;
+    }
+
+    if (n > atlas->max_slots) {
+        int new_max = FFMAX(n, 2 * atlas->max_slots);
+        if (!ASS_REALLOC_ARRAY(atlas->slots, new_max) ||
+                !ASS_REALLOC_ARRAY(atlas->new_slots, new_max))
+            return false;
+        atlas->max_slots = new_max;
+    }
+    // every new slot opens at most one shelf
+    int max_shelves = atlas->n_shelves + n;
+    if (max_shelves > atlas->max_shelves) {
+        int new_max = FFMAX(max_shelves, 2 * atlas->max_shelves);
+        if (!ASS_REALLOC_ARRAY(atlas->shelves, new_max))
+            return false;
+        atlas->max_shelves = new_max;
+    }
+    return true;
+}
+
+bool ass_atlas_update(Atlas *atlas, ASS_Image *images, int min_width)
+{
+    int n = 0, max_w = 0;
+    for (const ASS_Image *img = images; img; img = img->next) {
+        max_w = FFMAX(max_w, img->w);
+        n++;
+    }
+    if (!alloc_buffers(atlas, FFMAX(n, 1))) {
+        reset_atlas(atlas);
+        return false;
+    }
+
+    AtlasRef *refs = atlas->refs;
+    n = 0;
+    for (const ASS_Image *img = images; img; img = img->next) {
+        refs[n].img = img;
+        refs[n].index = n;
+        n++;
+    }
+    qsort(refs, n, sizeof(AtlasRef), cmp_ref);
+
+    // match images with the slots of the last update, keeping the key order
+    AtlasSlot *slots = atlas->slots, *new_slots = atlas->new_slots;
+    int n_new = 0, j = 0;
+    for (int i = 0; i < n;) {
+        const ASS_Image *img = refs[i].img;
+        while (j < atlas->n_slots && cmp_slot_image(slots + j, img) < 0)
+            release_slot(atlas, slots + j++);
+
+        AtlasSlot *slot = new_slots + n_new++;
+        if (j < atlas->n_slots && !cmp_slot_image(slots + j, img)) {
+            *slot = slots[j++];
+            slot->fresh = false;
+        } else {
+            *slot = image_key(img);
+            slot->shelf = -1;
+        }
+        for (; i < n && !cmp_slot_image(slot, refs[i].img); i++)
+            refs[i].slot = n_new - 1;
+    }
+    for (; j < atlas->n_slots; j++)
+        release_slot(atlas, slots + j);
+    while (atlas->n_shelves && !atlas->shelves[atlas->n_shelves - 1].n_slots)
+        atlas->n_shelves--;
+
+    int width = ass_align(ATLAS_WIDTH_ALIGN, FFMAX(FFMAX(min_width, max_w), 1));
+    bool packed = atlas->out.buffer && width <= atlas->out.w;
+    atlas->out.n_updated = 0;
+    for (int i = 0; packed && i < n_new; i++)
+        if (new_slots[i].shelf < 0)
+            packed = place_slot(atlas, new_slots + i, atlas->out.w, atlas->out.h);
+    if (!packed) {
+        // the atlas never gets narrower
+        width = FFMAX(width, atlas->out.w);
+        if (!repack(atlas, new_slots, n_new, width)) {
+            reset_atlas(atlas);
+            return false;
+        }
+        // slots have moved, find them again
+        for (int i = 0, k = 0; i < n; i++) {
+            while (cmp_slot_image(new_slots + k, refs[i].img))
+                k++;
+            refs[i].slot = k;
+        }
+    }
+
+    ASS_Atlas *out = &atlas->out;
+    for (int i = 0; i < n_new; i++) {
+        const AtlasSlot *slot = new_slots + i;
+        if (!slot->fresh)
+            continue;
+        unsigned char *dst = out->buffer + (ptrdiff_t) slot->y * out->stride + slot->x;
+        for (int y = 0; y < slot->h; y++)
+            memcpy(dst + (ptrdiff_t) y * out->stride,
+                   slot->bitmap + (ptrdiff_t) y * slot->stride, slot->w);
+        if (packed)
+            atlas->updated[out->n_updated++] =
+                (ASS_DirtyRect) { slot->x, slot->y, slot->w, slot->h };
+    }
+
+    for (int i = 0; i < n; i++) {
+        const ASS_Image *img = refs[i].img;
+        const AtlasSlot *slot = new_slots + refs[i].slot;
+        ASS_AtlasRect *rect = atlas->rects + refs[i].index;
+        rect->atlas_x = slot->x;
+        rect->atlas_y = slot->y;
+        rect->w = img->w;
+        rect->h = img->h;
+        rect->dst_x = img->dst_x;
+        rect->dst_y = img->dst_y;
+        rect->color = img->color;
+        rect->type = img->type;
+    }
+    out->rects = atlas->rects;
+    out->n_rects = n;
+    out->updated = atlas->updated;
+
+    atlas->slots = new_slots;
+    atlas->new_slots = slots;
+    atlas->n_slots = n_new;
+
+    ass_frame_ref(images);
+    ass_frame_unref(atlas->images);
+    atlas->images = images;
+    return true;
+}
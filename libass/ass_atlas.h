@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_ATLAS_H
+#define LIBASS_ATLAS_H
+
+#include <stdbool.h>
+
+#include "ass.h"
+
+// Packing of frame images into a single alpha buffer for ass_render_frame_atlas().
+// Bitmaps are placed on shelves, rows of slots with similar heights filled
+// from left to right. A slot is identified by the bitmap pointer and size
+// of its images; the image list of the last update is referenced, so equal
+// keys in the next frame are guaranteed to have equal contents and keep
+// their slot. Space of dropped slots is reclaimed once their shelf is empty.
+// Everything is packed again from scratch when a new bitmap does not fit.
+
+typedef struct atlas_slot AtlasSlot;
+typedef struct atlas_shelf AtlasShelf;
+typedef struct atlas_ref AtlasRef;
+
+typedef struct {
+    ASS_Atlas out;
+    ASS_Image *images;          // image list of the last update
+    AtlasSlot *slots;           // sorted by key
+    AtlasSlot *new_slots;       // temporary buffer for the next frame
+    int n_slots, max_slots;
+    AtlasShelf *shelves;        // sorted by vertical position
+    int n_shelves, max_shelves;
+    AtlasRef *refs;             // temporary buffer for sorting images
+    ASS_AtlasRect *rects;
+    ASS_DirtyRect *updated;
+    int max_images;
+} Atlas;
+
+void ass_atlas_done(Atlas *atlas);
+
+// Pack the images into the atlas, at least min_width pixels wide.
+// Returns false on allocation failure, the atlas is left empty then.
+bool ass_atlas_update(Atlas *atlas, ASS_Image *images, int min_width);
+
+#endif                          /* LIBASS_ATLAS_H */
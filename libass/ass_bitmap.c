@@ -35,6 +35,9 @@
 #include "ass_bitmap.h"
 #include "ass_render.h"
 
+// minimal area in pixels of bitmaps stored in sparse form when requested
+#define SPARSE_MIN_AREA (256 * 256)
+
 
 static void be_blur_pre(uint8_t *buf, intptr_t stride, intptr_t width, intptr_t height)
 {
@@ -115,6 +118,9 @@ bool ass_alloc_bitmap(const BitmapEngine *engine, Bitmap *bm,
     bm->h = h;
     bm->stride = s;
     bm->buffer = buf;
+    bm->tile_map = NULL;
+    bm->tile_order = 0;
+    bm->n_mixed = 0;
     return true;
 }
 
@@ -130,6 +136,7 @@ bool ass_realloc_bitmap(const BitmapEngine *engine, Bitmap *bm, int32_t w, int32
 void ass_free_bitmap(Bitmap *bm)
 {
     ass_aligned_free(bm->buffer);
+    free(bm->tile_map);
 }
 
 bool ass_copy_bitmap(const BitmapEngine *engine, Bitmap *dst, const Bitmap *src)
@@ -138,6 +145,7 @@ bool ass_copy_bitmap(const BitmapEngine *engine, Bitmap *dst, const Bitmap *src)
         memset(dst, 0, sizeof(*dst));
         return true;
     }
+    assert(!src->tile_map);
     if (!ass_alloc_bitmap(engine, dst, src->w, src->h, false))
         return false;
     dst->left = src->left;
@@ -146,8 +154,52 @@ bool ass_copy_bitmap(const BitmapEngine *engine, Bitmap *dst, const Bitmap *src)
     return true;
 }
 
+/**
+ * \brief Check whether a tile holds only the given value
+ */
+static bool tile_is_uniform(const uint8_t *tile, size_t size, uint8_t value)
+{
+    for (size_t i = 0; i < size; i++)
+        if (tile[i] != value)
+            return false;
+    return true;
+}
+
+/**
+ * \brief Move the mixed tiles of a sparse fill into the bitmap,
+ * turning tiles that came out uniform into empty or solid ones
+ */
+static bool store_sparse_tiles(const BitmapEngine *engine, Bitmap *bm,
+                               const RasterizerData *rst)
+{
+    size_t tile_size = (size_t) 1 << (2 * bm->tile_order);
+    size_t n_tiles = (size_t) (bm->w >> bm->tile_order) * (bm->h >> bm->tile_order);
+    unsigned align = 1 << engine->align_order;
+    bm->buffer = ass_aligned_alloc(align, FFMAX(rst->n_sparse_tiles, 1) * tile_size, false);
+    if (!bm->buffer)
+        return false;
+
+    int32_t n_mixed = 0;
+    for (size_t i = 0; i < n_tiles; i++) {
+        if (bm->tile_map[i] < 0)
+            continue;
+        const uint8_t *tile = rst->sparse_tiles + bm->tile_map[i] * tile_size;
+        if (tile_is_uniform(tile, tile_size, 0)) {
+            bm->tile_map[i] = SPARSE_TILE_EMPTY;
+        } else if (tile_is_uniform(tile, tile_size, 255)) {
+            bm->tile_map[i] = SPARSE_TILE_SOLID;
+        } else {
+            memcpy(bm->buffer + n_mixed * tile_size, tile, tile_size);
+            bm->tile_map[i] = n_mixed++;
+        }
+    }
+    bm->n_mixed = n_mixed;
+    return true;
+}
+
 bool ass_outline_to_bitmap(RenderContext *state, Bitmap *bm,
-                           ASS_Outline *outline1, ASS_Outline *outline2)
+                           ASS_Outline *outline1, ASS_Outline *outline2,
+                           bool sparse)
 {
     ASS_Renderer *render_priv = state->renderer;
     RasterizerData *rst = &state->rasterizer;
@@ -170,7 +222,9 @@ bool ass_outline_to_bitmap(RenderContext *state, Bitmap *bm,
     int32_t w = x_max - x_min;
     int32_t h = y_max - y_min;
 
-    int mask = (1 << render_priv->engine.tile_order) - 1;
+    const TileEngine *tiles = ass_rasterizer_select_tiles(&render_priv->engine, rst,
+                                                          render_priv->settings.tile_size);
+    int mask = (1 << tiles->tile_order) - 1;
 
     // XXX: is that possible to trigger at all?
     if (w < 0 || h < 0 || w > INT_MAX - mask || h > INT_MAX - mask) {
@@ -181,12 +235,35 @@ bool ass_outline_to_bitmap(RenderContext *state, Bitmap *bm,
 
     int32_t tile_w = (w + mask) & ~mask;
     int32_t tile_h = (h + mask) & ~mask;
+    if (sparse && (int64_t) tile_w * tile_h >= SPARSE_MIN_AREA) {
+        size_t n_tiles = (size_t) (tile_w >> tiles->tile_order) * (tile_h >> tiles->tile_order);
+        memset(bm, 0, sizeof(*bm));
+        bm->tile_map = ass_realloc_array(NULL, n_tiles, sizeof(int32_t));
+        if (!bm->tile_map)
+            return false;
+        bm->left = x_min;
+        bm->top  = y_min;
+        bm->w = tile_w;
+        bm->h = tile_h;
+        bm->stride = 1 << tiles->tile_order;
+        bm->tile_order = tiles->tile_order;
+
+        if (!ass_rasterizer_fill_sparse(tiles, rst, bm->tile_map,
+                                        x_min, y_min, tile_w, tile_h) ||
+                !store_sparse_tiles(&render_priv->engine, bm, rst)) {
+            ass_msg(render_priv->library, MSGL_WARN, "Failed to rasterize glyph!\n");
+            ass_free_bitmap(bm);
+            return false;
+        }
+        return true;
+    }
+
     if (!ass_alloc_bitmap(&render_priv->engine, bm, tile_w, tile_h, false))
         return false;
     bm->left = x_min;
     bm->top  = y_min;
 
-    if (!ass_rasterizer_fill(&render_priv->engine, rst, bm->buffer,
+    if (!ass_rasterizer_fill(tiles, rst, bm->buffer,
                              x_min, y_min, bm->stride, tile_h, bm->stride)) {
         ass_msg(render_priv->library, MSGL_WARN, "Failed to rasterize glyph!\n");
         ass_free_bitmap(bm);
@@ -196,6 +273,69 @@ bool ass_outline_to_bitmap(RenderContext *state, Bitmap *bm,
     return true;
 }
 
+/**
+ * \brief Check whether a rectangle of a bitmap has a single value
+ * \param x, y, w, h rectangle relative to the bitmap, must lie inside it
+ * \return 0 or 255 if the rectangle is uniformly empty or solid, -1 otherwise
+ * Only looks at tile states, so dense bitmaps always give -1.
+ */
+int ass_bitmap_uniform_value(const Bitmap *bm, int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    if (!bm->tile_map || w <= 0 || h <= 0)
+        return -1;
+
+    int order = bm->tile_order;
+    int32_t cols = bm->w >> order;
+    int32_t state = bm->tile_map[(y >> order) * cols + (x >> order)];
+    if (state >= 0)
+        return -1;
+    for (int32_t ty = y >> order; ty <= (y + h - 1) >> order; ty++)
+        for (int32_t tx = x >> order; tx <= (x + w - 1) >> order; tx++)
+            if (bm->tile_map[ty * cols + tx] != state)
+                return -1;
+    return state == SPARSE_TILE_SOLID ? 255 : 0;
+}
+
+/**
+ * \brief Copy a rectangle of a dense or sparse bitmap into a dense buffer
+ * \param x, y, w, h rectangle relative to the bitmap, must lie inside it
+ */
+void ass_bitmap_extract(const Bitmap *bm, uint8_t *dst, ptrdiff_t dst_stride,
+                        int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    if (!bm->tile_map) {
+        const uint8_t *src = bm->buffer + y * bm->stride + x;
+        for (int32_t i = 0; i < h; i++)
+            memcpy(dst + i * dst_stride, src + i * bm->stride, w);
+        return;
+    }
+
+    int order = bm->tile_order;
+    int32_t size = 1 << order, mask = size - 1;
+    int32_t cols = bm->w >> order;
+    for (int32_t y0 = y; y0 < y + h;) {
+        int32_t y1 = FFMIN((y0 | mask) + 1, y + h);
+        const int32_t *tile_map = bm->tile_map + (y0 >> order) * cols;
+        for (int32_t x0 = x; x0 < x + w;) {
+            int32_t x1 = FFMIN((x0 | mask) + 1, x + w);
+            int32_t state = tile_map[x0 >> order];
+            uint8_t *out = dst + (y0 - y) * dst_stride + (x0 - x);
+            const uint8_t *src = state < 0 ? NULL :
+                bm->buffer + ((ptrdiff_t) state << (2 * order)) +
+                ((y0 & mask) << order) + (x0 & mask);
+            for (int32_t i = 0; i < y1 - y0; i++) {
+                if (src)
+                    memcpy(out + i * dst_stride, src + (i << order), x1 - x0);
+                else
+                    memset(out + i * dst_stride,
+                           state == SPARSE_TILE_SOLID ? 255 : 0, x1 - x0);
+            }
+            x0 = x1;
+        }
+        y0 = y1;
+    }
+}
+
 /**
  * \brief fix outline bitmap
  *
@@ -258,3 +398,24 @@ void ass_shift_bitmap(Bitmap *bm, int shift_x, int shift_y)
             }
         }
 }
+
+/**
+ * \brief Copy a bitmap shifted by the fraction of a pixel,
+ * growing it by a pixel in the direction of the shift
+ */
+bool ass_copy_shifted_bitmap(const BitmapEngine *engine, Bitmap *dst,
+                             const Bitmap *src, int shift_x, int shift_y)
+{
+    if (!src->buffer) {
+        memset(dst, 0, sizeof(*dst));
+        return true;
+    }
+    if (!ass_alloc_bitmap(engine, dst, src->w + !!shift_x, src->h + !!shift_y, true))
+        return false;
+    dst->left = src->left;
+    dst->top  = src->top;
+    for (int32_t y = 0; y < src->h; y++)
+        memcpy(dst->buffer + y * dst->stride, src->buffer + y * src->stride, src->w);
+    ass_shift_bitmap(dst, shift_x, shift_y);
+    return true;
+}
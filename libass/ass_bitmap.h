@@ -27,11 +27,24 @@
 #include "ass_outline.h"
 #include "ass_bitmap_engine.h"
 
+// tile states of sparse bitmaps, other values are indices of mixed tiles
+enum {
+    SPARSE_TILE_EMPTY = -1,
+    SPARSE_TILE_SOLID = -2,
+};
+
 typedef struct {
     int32_t left, top;
     int32_t w, h;         // width, height
     ptrdiff_t stride;
     uint8_t *buffer;      // h * stride buffer
+    // Sparse form for large masks, made of square tiles of which only
+    // the mixed ones are stored in buffer, one after another with
+    // the tile size as stride; w and h are multiples of the tile size.
+    // Only bitmaps requested as sparse can have this form.
+    int32_t *tile_map;    // tile states in row order, NULL for dense bitmaps
+    int tile_order;
+    int32_t n_mixed;
 } Bitmap;
 
 bool ass_alloc_bitmap(const BitmapEngine *engine, Bitmap *bm, int32_t w, int32_t h, bool zero);
@@ -42,13 +55,20 @@ void ass_free_bitmap(Bitmap *bm);
 struct render_context;
 
 bool ass_outline_to_bitmap(struct render_context *state, Bitmap *bm,
-                           ASS_Outline *outline1, ASS_Outline *outline2);
+                           ASS_Outline *outline1, ASS_Outline *outline2,
+                           bool sparse);
+
+int ass_bitmap_uniform_value(const Bitmap *bm, int32_t x, int32_t y, int32_t w, int32_t h);
+void ass_bitmap_extract(const Bitmap *bm, uint8_t *dst, ptrdiff_t dst_stride,
+                        int32_t x, int32_t y, int32_t w, int32_t h);
 
 void ass_synth_blur(const BitmapEngine *engine, Bitmap *bm,
                     int be, double blur_r2x, double blur_r2y);
 
 bool ass_gaussian_blur(const BitmapEngine *engine, Bitmap *bm, double r2x, double r2y);
 void ass_shift_bitmap(Bitmap *bm, int shift_x, int shift_y);
+bool ass_copy_shifted_bitmap(const BitmapEngine *engine, Bitmap *dst,
+                             const Bitmap *src, int shift_x, int shift_y);
 void ass_fix_outline(Bitmap *bm_g, Bitmap *bm_o);
 
 #endif                          /* LIBASS_BITMAP_H */
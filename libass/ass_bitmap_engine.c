@@ -32,9 +32,8 @@
     MergeTileFunc         ass_merge_tile          ## tile_size ## _ ## suffix;
 
 #define RASTERIZER_FUNCTION(name, suffix) \
-    engine.name = mask & ASS_FLAG_LARGE_TILES ? \
-        ass_ ## name ## _tile32_ ## suffix : \
-        ass_ ## name ## _tile16_ ## suffix;
+    engine.tile16.name = ass_ ## name ## _tile16_ ## suffix; \
+    engine.tile32.name = ass_ ## name ## _tile32_ ## suffix;
 
 #define RASTERIZER_FUNCTIONS(suffix) \
     RASTERIZER_FUNCTION(fill_solid,     suffix) \
@@ -59,6 +58,15 @@
     GENERIC_FUNCTION(be_blur,      suffix)
 
 
+#define FRAME_BLEND_FUNCTIONS(suffix) \
+    BlendRGBAFunc ass_blend_rgba_ ## suffix; \
+    BlendPlaneFunc ass_blend_plane8_ ## suffix; \
+    BlendPlaneFunc ass_blend_plane10_ ## suffix; \
+    engine.blend_rgba = ass_blend_rgba_ ## suffix; \
+    engine.blend_plane8 = ass_blend_plane8_ ## suffix; \
+    engine.blend_plane10 = ass_blend_plane10_ ## suffix;
+
+
 #define PARAM_BLUR_SET(suffix) \
     ass_blur4_ ## suffix, \
     ass_blur5_ ## suffix, \
@@ -123,7 +131,7 @@ unsigned ass_get_cpu_flags(unsigned mask)
     ass_get_cpuid(&eax, &ebx, &ecx, &edx);
     uint32_t max_leaf = eax;
 
-    bool avx = false;
+    bool avx = false, avx512 = false;
     if (max_leaf >= 1) {
         eax = 1;
         ass_get_cpuid(&eax, &ebx, &ecx, &edx);
@@ -141,14 +149,25 @@ unsigned ass_get_cpu_flags(unsigned mask)
             if (xcr0l & (1 << 1) &&  // XSAVE for XMM
                 xcr0l & (1 << 2))    // XSAVE for YMM
                     avx = true;
+            if (avx &&
+                xcr0l & (1 << 5) &&  // XSAVE for opmask
+                xcr0l & (1 << 6) &&  // XSAVE for upper halves of ZMM0-15
+                xcr0l & (1 << 7))    // XSAVE for ZMM16-31
+                    avx512 = true;
         }
     }
 
     if (max_leaf >= 7) {
         eax = 7;
         ass_get_cpuid(&eax, &ebx, &ecx, &edx);
-        if (avx && ebx & (1 << 5))  // AVX2
+        if (avx && ebx & (1 << 5)) {  // AVX2
             flags |= ASS_CPU_FLAG_X86_AVX2;
+            if (avx512 &&
+                ebx & (1 << 16) &&   // AVX512F
+                ebx & (1 << 30) &&   // AVX512BW
+                ebx & (1u << 31))    // AVX512VL
+                    flags |= ASS_CPU_FLAG_X86_AVX512;
+        }
     }
 
 #endif
@@ -168,8 +187,14 @@ BitmapEngine ass_bitmap_engine_init(unsigned mask)
 {
     ALL_PROTOTYPES(16, c)
     BLUR_PROTOTYPES(32, c)
+    BLUR_PROTOTYPES(64, c)
     BitmapEngine engine = {0};
-    engine.tile_order = mask & ASS_FLAG_LARGE_TILES ? 5 : 4;
+    engine.tile16.tile_order = 4;
+    engine.tile32.tile_order = 5;
+
+    FRAME_BLEND_FUNCTIONS(c)
+    BlendRGBAFunc ass_blend_rgba_straight_c;
+    engine.blend_rgba_straight = ass_blend_rgba_straight_c;
 
 #if CONFIG_ASM
     unsigned flags = ass_get_cpu_flags(mask);
@@ -177,10 +202,24 @@ BitmapEngine ass_bitmap_engine_init(unsigned mask)
     if (flags & ASS_CPU_FLAG_X86_AVX2) {
         ALL_PROTOTYPES(32, avx2)
         ALL_FUNCTIONS(5, 32, avx2)
+        FRAME_BLEND_FUNCTIONS(avx2)
+#if ARCH_X86_64
+        if (flags & ASS_CPU_FLAG_X86_AVX512) {
+            BitmapBlendFunc ass_add_bitmaps_avx512;
+            BitmapBlendFunc ass_imul_bitmaps_avx512;
+            BitmapMulFunc   ass_mul_bitmaps_avx512;
+            BLUR_PROTOTYPES(64, avx512)
+            GENERIC_FUNCTION(add_bitmaps,  avx512)
+            GENERIC_FUNCTION(imul_bitmaps, avx512)
+            GENERIC_FUNCTION(mul_bitmaps,  avx512)
+            BLUR_FUNCTIONS(6, 64, avx512)
+        }
+#endif
         return engine;
     } else if (flags & ASS_CPU_FLAG_X86_SSE2) {
         ALL_PROTOTYPES(16, sse2)
         ALL_FUNCTIONS(4, 16, sse2)
+        FRAME_BLEND_FUNCTIONS(sse2)
         if (flags & ASS_CPU_FLAG_X86_SSSE3) {
             ALL_PROTOTYPES(16, ssse3)
             RASTERIZER_FUNCTION(fill_generic, ssse3)
@@ -195,6 +234,7 @@ BitmapEngine ass_bitmap_engine_init(unsigned mask)
     if (flags & ASS_CPU_FLAG_ARM_NEON) {
         ALL_PROTOTYPES(16, neon)
         ALL_FUNCTIONS(4, 16, neon)
+        FRAME_BLEND_FUNCTIONS(neon)
         return engine;       
     }
 #elif ARCH_RISCV
@@ -207,7 +247,9 @@ BitmapEngine ass_bitmap_engine_init(unsigned mask)
 #endif
 
     ALL_FUNCTIONS(4, 16, c)
-    if (mask & ASS_FLAG_WIDE_STRIPE) {
+    if (mask & ASS_FLAG_WIDER_STRIPE) {
+        BLUR_FUNCTIONS(6, 64, c)
+    } else if (mask & ASS_FLAG_WIDE_STRIPE) {
         BLUR_FUNCTIONS(5, 32, c)
     }
     return engine;
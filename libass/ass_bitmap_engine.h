@@ -26,9 +26,10 @@
  * All of these routines require some basic preconditions about their args:
  * - Widths and heights must be > 0
  * - For be_blur, width and height must be > 1
- * - All strides must be multiples of the engine alignment
- * - All buffers, except for BitmapBlendFunc and sources of BitmapMulFunc,
- *   must be aligned to the engine alignment
+ * - All strides, except for BlendRGBAFunc and BlendPlaneFunc, must be
+ *   multiples of the engine alignment
+ * - All buffers, except for BitmapBlendFunc, BlendRGBAFunc, BlendPlaneFunc
+ *   and sources of BitmapMulFunc, must be aligned to the engine alignment
  */
 
 struct segment;
@@ -48,6 +49,20 @@ typedef void BitmapMulFunc(uint8_t *restrict dst, ptrdiff_t dst_stride,
                            const uint8_t *restrict src2, ptrdiff_t src2_stride,
                            size_t width, size_t height);
 
+// blend color with alpha mask src over 4-byte pixels,
+// color holds the channels in memory order and the opacity in the highest byte
+typedef void BlendRGBAFunc(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                           const uint8_t *restrict src, ptrdiff_t src_stride,
+                           size_t width, size_t height, uint32_t color);
+
+// blend with alpha mask src over a plane of 8-bit or 16-bit samples,
+// 16-bit samples hold 10-bit values in the highest bits;
+// color holds the values of even and odd samples in bits 0-11 and 12-23
+// and the opacity in the highest byte
+typedef void BlendPlaneFunc(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                            const uint8_t *restrict src, ptrdiff_t src_stride,
+                            size_t width, size_t height, uint32_t color);
+
 typedef void BeBlurFunc(uint8_t *restrict buf, ptrdiff_t stride,
                         size_t width, size_t height, uint16_t *restrict tmp);
 
@@ -62,20 +77,29 @@ typedef void ParamFilterFunc(int16_t *restrict dst, const int16_t *restrict src,
                              size_t src_width, size_t src_height,
                              const int16_t *restrict param);
 
+// rasterizer functions for one tile size
 typedef struct {
-    int align_order;  // log2(alignment)
-
-    // rasterizer functions
     int tile_order;  // log2(tile_size)
     FillSolidTileFunc *fill_solid;
     FillHalfplaneTileFunc *fill_halfplane;
     FillGenericTileFunc *fill_generic;
     MergeTileFunc *merge;
+} TileEngine;
+
+typedef struct {
+    int align_order;  // log2(alignment)
+
+    // rasterizer functions, both tile sizes are always available
+    TileEngine tile16, tile32;
 
     // blend functions
     BitmapBlendFunc *add_bitmaps, *imul_bitmaps;
     BitmapMulFunc *mul_bitmaps;
 
+    // frame compositing functions, for premultiplied and straight alpha
+    BlendRGBAFunc *blend_rgba, *blend_rgba_straight;
+    BlendPlaneFunc *blend_plane8, *blend_plane10;
+
     // be blur function
     BeBlurFunc *be_blur;
 
@@ -93,14 +117,15 @@ enum {
     ASS_CPU_FLAG_X86_SSE2      = 0x0001,
     ASS_CPU_FLAG_X86_SSSE3     = 0x0002,
     ASS_CPU_FLAG_X86_AVX2      = 0x0004,
+    ASS_CPU_FLAG_X86_AVX512    = 0x0008,
 #elif ARCH_AARCH64
     ASS_CPU_FLAG_ARM_NEON      = 0x0001,
 #elif ARCH_RISCV
     ASS_CPU_FLAG_RISCV_RVV     = 0x0001,
 #endif
     ASS_CPU_FLAG_ALL           = 0x0FFF,
-    ASS_FLAG_LARGE_TILES       = 0x1000,
     ASS_FLAG_WIDE_STRIPE       = 0x2000,  // for C version only
+    ASS_FLAG_WIDER_STRIPE      = 0x4000,  // for C version only
 };
 
 unsigned ass_get_cpu_flags(unsigned mask);
@@ -28,6 +28,7 @@
 #include "ass_utils.h"
 #include "ass_font.h"
 #include "ass_outline.h"
+#include "ass_threading.h"
 #include "ass_cache.h"
 
 // Always enable native-endian mode, since we don't care about cross-platform consistency of the hash
@@ -111,7 +112,7 @@ const CacheDesc bitmap_cache_desc = {
 
 
 // composite cache
-static ass_hashcode composite_hash(void *key, ass_hashcode hval)
+static inline ass_hashcode composite_hash(void *key, ass_hashcode hval)
 {
     CompositeHashKey *k = key;
     hval = filter_hash(&k->filter, hval);
@@ -120,7 +121,7 @@ static ass_hashcode composite_hash(void *key, ass_hashcode hval)
     return hval;
 }
 
-static bool composite_compare(void *a, void *b)
+static inline bool composite_compare(void *a, void *b)
 {
     CompositeHashKey *ak = a;
     CompositeHashKey *bk = b;
@@ -178,7 +179,7 @@ const CacheDesc composite_cache_desc = {
 
 
 // outline cache
-static ass_hashcode outline_hash(void *key, ass_hashcode hval)
+static inline ass_hashcode outline_hash(void *key, ass_hashcode hval)
 {
     OutlineHashKey *k = key;
     switch (k->type) {
@@ -193,7 +194,7 @@ static ass_hashcode outline_hash(void *key, ass_hashcode hval)
     }
 }
 
-static bool outline_compare(void *a, void *b)
+static inline bool outline_compare(void *a, void *b)
 {
     OutlineHashKey *ak = a;
     OutlineHashKey *bk = b;
@@ -327,22 +328,81 @@ const CacheDesc glyph_metrics_cache_desc = {
 
 
 // Cache data
+typedef struct cache_shard CacheShard;
+typedef struct cache_arena CacheArena;
+typedef struct cache_queue CacheQueue;
+
 typedef struct cache_item {
-    Cache *cache;
+    CacheShard *shard;  // NULL if orphaned by ass_cache_empty()
+    CacheArena *arena;  // storage the item was allocated from
     const CacheDesc *desc;
-    struct cache_item *next, **prev;
+    ass_hashcode hash;
+    CacheQueue *queue;  // NULL if not queued for eviction
     struct cache_item *queue_next, **queue_prev;
-    size_t size, ref_count;
+    size_t size;        // 0 while the value is being constructed
+    size_t ref_count;   // accessed atomically
+    // time span of the events using the item, empty if untagged
+    long long span_start, span_end;
 } CacheItem;
 
-struct cache {
-    unsigned buckets;
-    CacheItem **map;
-    CacheItem *queue_first, **queue_last;
+// Hash table slot; the full hash is kept next to the item pointer
+// so that almost all mismatches are rejected without touching the item.
+typedef struct {
+    ass_hashcode hash;
+    CacheItem *item;    // NULL for empty slots
+} CacheSlot;
+
+// Eviction queue in least to most recently used order.
+// Every queued item holds a reference to itself.
+struct cache_queue {
+    CacheItem *first, **last;
+    size_t size;        // total footprint of queued items
+};
 
-    const CacheDesc *desc;
+// Segmented LRU: new items enter the probation queue and move to the
+// protected one on their first hit. Eviction takes from probation first,
+// so a burst of items used only once cannot flush the working set.
+// With ASS_CACHE_POLICY_LRU only the probation queue is used.
+enum {
+    QUEUE_PROBATION,
+    QUEUE_PROTECTED,
+    QUEUE_COUNT
+};
+
+// Maximal part of the cache size taken by protected items, in percent
+#define CACHE_PROTECTED_SHARE 80
+
+// Items are distributed over independently locked shards by hash
+// so that concurrent lookups rarely contend for the same lock.
+// Each shard is an open-addressing hash table with linear probing,
+// which grows and shrinks with the number of items.
+struct cache_shard {
+    ASS_Mutex lock;     // protects everything in the shard
+    ASS_Cond ready;     // signaled when an item finishes construction
+    CacheArena *arena;
+
+    CacheSlot *slots;
+    size_t capacity;    // power of two
+    size_t count;
+    CacheQueue queue[QUEUE_COUNT];
 
     size_t cache_size;
+    size_t resident;    // approximate memory use in bytes
+
+    // statistics, see ASS_CacheCounters
+    uint64_t hits, misses, constructions, evictions;
+    int64_t construct_time;
+};
+
+#define CACHE_SHARD_ORDER 4
+#define CACHE_SHARDS (1 << CACHE_SHARD_ORDER)
+#define CACHE_MIN_CAPACITY 16
+
+struct cache {
+    const CacheDesc *desc;
+    ASS_CachePolicy policy;
+    long long now, lookahead;   // lookahead < 0 if timeline is unused
+    CacheShard shards[CACHE_SHARDS];
 };
 
 #define CACHE_ALIGN 8
@@ -358,6 +418,167 @@ static inline CacheItem *value_to_item(void *value)
     return (CacheItem *) ((char *) value - CACHE_ITEM_SIZE);
 }
 
+static inline size_t item_footprint(CacheItem *item)
+{
+    return item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+}
+
+// Fixed-size item allocator.
+// Items of a shard are carved out of large slabs and recycled through
+// a free list; slab memory is only returned in bulk, once no item allocated
+// from the arena is alive anymore. Items orphaned by ass_cache_empty() can
+// outlive their cache, in which case the arena is detached on ass_cache_done()
+// and freed together with the last item.
+
+typedef struct cache_slab {
+    struct cache_slab *next;
+} CacheSlab;
+
+#define CACHE_SLAB_HEADER align_cache(sizeof(CacheSlab))
+#define CACHE_SLAB_SIZE (64 * 1024)
+#define CACHE_SLAB_MIN_ITEMS 16
+
+struct cache_arena {
+    ASS_Mutex lock;     // items are freed outside of shard locks
+    size_t item_size, slab_items;
+    CacheSlab *slabs;   // newest first
+    size_t slab_fill;   // items handed out from the newest slab
+    void *free_list;
+    size_t live;        // number of allocated items
+    bool detached;
+};
+
+// Approximate memory use of an item in bytes. Unlike the footprint,
+// which is in the units of the per-cache limits, size 1 here denotes
+// a value of unknown size, for which only the item storage is counted.
+static inline size_t item_resident(CacheItem *item)
+{
+    return item->arena->item_size + (item->size == 1 ? 0 : item->size);
+}
+
+static CacheArena *arena_create(size_t item_size)
+{
+    CacheArena *arena = calloc(1, sizeof(*arena));
+    if (!arena)
+        return NULL;
+    if (!ass_mutex_init(&arena->lock)) {
+        free(arena);
+        return NULL;
+    }
+    arena->item_size = align_cache(item_size);
+    arena->slab_items = FFMAX(CACHE_SLAB_MIN_ITEMS,
+                              (CACHE_SLAB_SIZE - CACHE_SLAB_HEADER) / arena->item_size);
+    return arena;
+}
+
+// Release all slabs at once; only valid while no item is alive
+static void arena_release_slabs(CacheArena *arena)
+{
+    assert(!arena->live);
+    CacheSlab *slab = arena->slabs;
+    while (slab) {
+        CacheSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    arena->slabs = NULL;
+    arena->slab_fill = 0;
+    arena->free_list = NULL;
+}
+
+static void arena_destroy(CacheArena *arena)
+{
+    arena_release_slabs(arena);
+    ass_mutex_destroy(&arena->lock);
+    free(arena);
+}
+
+static void *arena_alloc(CacheArena *arena)
+{
+    void *ptr = NULL;
+    ass_mutex_lock(&arena->lock);
+    if (arena->free_list) {
+        ptr = arena->free_list;
+        arena->free_list = *(void **) ptr;
+    } else {
+        if (!arena->slabs || arena->slab_fill == arena->slab_items) {
+            CacheSlab *slab = malloc(CACHE_SLAB_HEADER + arena->slab_items * arena->item_size);
+            if (!slab)
+                goto done;
+            slab->next = arena->slabs;
+            arena->slabs = slab;
+            arena->slab_fill = 0;
+        }
+        ptr = (char *) arena->slabs + CACHE_SLAB_HEADER +
+            arena->slab_fill++ * arena->item_size;
+    }
+    arena->live++;
+done:
+    ass_mutex_unlock(&arena->lock);
+    return ptr;
+}
+
+static void arena_free(CacheArena *arena, void *ptr)
+{
+    ass_mutex_lock(&arena->lock);
+    *(void **) ptr = arena->free_list;
+    arena->free_list = ptr;
+    bool release = !--arena->live && arena->detached;
+    ass_mutex_unlock(&arena->lock);
+    if (release)
+        arena_destroy(arena);
+}
+
+// Bulk teardown: give back all memory if nothing is alive anymore,
+// otherwise let the last item free the arena if the cache is going away
+static void arena_trim(CacheArena *arena, bool detach)
+{
+    ass_mutex_lock(&arena->lock);
+    bool idle = !arena->live;
+    if (idle)
+        arena_release_slabs(arena);
+    else
+        arena->detached = detach;
+    ass_mutex_unlock(&arena->lock);
+    if (idle && detach)
+        arena_destroy(arena);
+}
+
+
+static bool shard_init(CacheShard *shard, const CacheDesc *desc)
+{
+    shard->capacity = CACHE_MIN_CAPACITY;
+    for (int i = 0; i < QUEUE_COUNT; i++)
+        shard->queue[i].last = &shard->queue[i].first;
+    shard->slots = calloc(shard->capacity, sizeof(CacheSlot));
+    if (!shard->slots)
+        return false;
+    shard->arena = arena_create(CACHE_ITEM_SIZE + align_cache(desc->value_size) +
+                                desc->key_size);
+    if (!shard->arena)
+        goto fail_slots;
+    if (!ass_mutex_init(&shard->lock))
+        goto fail_arena;
+    if (!ass_cond_init(&shard->ready))
+        goto fail_lock;
+    return true;
+
+fail_lock:
+    ass_mutex_destroy(&shard->lock);
+fail_arena:
+    arena_destroy(shard->arena);
+fail_slots:
+    free(shard->slots);
+    return false;
+}
+
+static void shard_done(CacheShard *shard)
+{
+    ass_cond_destroy(&shard->ready);
+    ass_mutex_destroy(&shard->lock);
+    arena_trim(shard->arena, true);
+    free(shard->slots);
+}
 
 // Create a cache with type-specific hash/compare/destruct/size functions
 Cache *ass_cache_create(const CacheDesc *desc)
@@ -365,11 +586,14 @@ Cache *ass_cache_create(const CacheDesc *desc)
     Cache *cache = calloc(1, sizeof(*cache));
     if (!cache)
         return NULL;
-    cache->buckets = 0xFFFF;
-    cache->queue_last = &cache->queue_first;
     cache->desc = desc;
-    cache->map = calloc(cache->buckets, sizeof(CacheItem *));
-    if (!cache->map) {
+    cache->policy = ASS_CACHE_POLICY_LRU;
+    cache->lookahead = -1;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        if (shard_init(&cache->shards[i], desc))
+            continue;
+        while (i--)
+            shard_done(&cache->shards[i]);
         free(cache);
         return NULL;
     }
@@ -377,82 +601,243 @@ Cache *ass_cache_create(const CacheDesc *desc)
     return cache;
 }
 
-// Retrieve a value corresponding to a particular cache key,
-// creating one if it does not already exist.
-// The returned item is guaranteed to be valid until the next ass_cache_cut call;
-// to extend its lifetime further, call ass_cache_inc_ref().
-void *ass_cache_get(Cache *cache, void *key, void *priv)
+// Reallocate the table of a shard, keeping all items
+static bool shard_resize(CacheShard *shard, size_t capacity)
+{
+    CacheSlot *slots = calloc(capacity, sizeof(CacheSlot));
+    if (!slots)
+        return false;
+
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < shard->capacity; i++) {
+        if (!shard->slots[i].item)
+            continue;
+        size_t pos = shard->slots[i].hash & mask;
+        while (slots[pos].item)
+            pos = (pos + 1) & mask;
+        slots[pos] = shard->slots[i];
+    }
+
+    free(shard->slots);
+    shard->slots = slots;
+    shard->capacity = capacity;
+    return true;
+}
+
+// Find the item with the given key, or the empty slot where it belongs
+static inline CacheSlot *find_slot(CacheShard *shard, const CacheDesc *desc,
+                                   ass_hashcode hash, void *key,
+                                   HashCompare compare_func)
 {
-    const CacheDesc *desc = cache->desc;
     size_t key_offs = CACHE_ITEM_SIZE + align_cache(desc->value_size);
-    unsigned bucket = desc->hash_func(key, ASS_HASH_INIT) % cache->buckets;
-    CacheItem *item = cache->map[bucket];
-    while (item) {
-        if (desc->compare_func(key, (char *) item + key_offs)) {
-            assert(item->size);
-            if (!item->queue_prev || item->queue_next) {
-                if (item->queue_prev) {
-                    item->queue_next->queue_prev = item->queue_prev;
-                    *item->queue_prev = item->queue_next;
-                } else
-                    item->ref_count++;
-                *cache->queue_last = item;
-                item->queue_prev = cache->queue_last;
-                cache->queue_last = &item->queue_next;
-                item->queue_next = NULL;
-            }
-            desc->key_move_func(NULL, key);
+    size_t mask = shard->capacity - 1;
+    size_t pos = hash & mask;
+    while (true) {
+        CacheSlot *slot = &shard->slots[pos];
+        if (!slot->item)
+            return slot;
+        if (slot->hash == hash &&
+                compare_func(key, (char *) slot->item + key_offs))
+            return slot;
+        pos = (pos + 1) & mask;
+    }
+}
 
-            return (char *) item + CACHE_ITEM_SIZE;
+// Unlink an item from the table by shifting back the rest of its probe run,
+// which keeps lookups free of tombstones
+static void remove_item(CacheShard *shard, CacheItem *item)
+{
+    size_t mask = shard->capacity - 1;
+    size_t pos = item->hash & mask;
+    while (shard->slots[pos].item != item)
+        pos = (pos + 1) & mask;
+
+    size_t next = pos;
+    while (true) {
+        next = (next + 1) & mask;
+        CacheSlot *slot = &shard->slots[next];
+        if (!slot->item)
+            break;
+        // move the entry into the hole unless its home slot lies in (pos, next]
+        if (((next - slot->hash) & mask) >= ((next - pos) & mask)) {
+            shard->slots[pos] = *slot;
+            pos = next;
         }
-        item = item->next;
     }
+    shard->slots[pos].item = NULL;
+    shard->count--;
+    shard->evictions++;
+
+    shard->cache_size -= item_footprint(item);
+    shard->resident -= item_resident(item);
+}
+
+static inline void queue_append(CacheQueue *queue, CacheItem *item)
+{
+    *queue->last = item;
+    item->queue_prev = queue->last;
+    queue->last = &item->queue_next;
+    item->queue_next = NULL;
+    item->queue = queue;
+    queue->size += item_footprint(item);
+}
+
+static inline void queue_unlink(CacheItem *item)
+{
+    CacheQueue *queue = item->queue;
+    if (item->queue_next)
+        item->queue_next->queue_prev = item->queue_prev;
+    else
+        queue->last = item->queue_prev;
+    *item->queue_prev = item->queue_next;
+    queue->size -= item_footprint(item);
+    item->queue = NULL;
+}
+
+// Move a found item to the end of its target queue,
+// re-adding it there if it has been cut
+static inline void *touch_item(CacheShard *shard, CacheItem *item,
+                               ASS_CachePolicy policy)
+{
+    assert(item->size);
+    CacheQueue *queue = &shard->queue[
+        policy == ASS_CACHE_POLICY_SLRU ? QUEUE_PROTECTED : QUEUE_PROBATION];
+    if (item->queue != queue || item->queue_next) {
+        if (item->queue)
+            queue_unlink(item);
+        else
+            ass_atomic_add(&item->ref_count, 1);
+        queue_append(queue, item);
+    }
+    return (char *) item + CACHE_ITEM_SIZE;
+}
+
+static inline void destroy_item(const CacheDesc *desc, CacheItem *item)
+{
+    assert(item->desc == desc);
+    char *value = (char *) item + CACHE_ITEM_SIZE;
+    desc->destruct_func(value + align_cache(desc->value_size), value);
+    arena_free(item->arena, item);
+}
 
-    item = malloc(key_offs + desc->key_size);
-    if (!item) {
+// Lookup implementation shared by the generic and the type-specialized
+// entry points; inlined into each of them, so that a constant compare_func
+// becomes a direct, inlinable call in the probe loop
+static inline void *cache_get(Cache *cache, void *key, void *priv,
+                              ass_hashcode hash, HashCompare compare_func)
+{
+    const CacheDesc *desc = cache->desc;
+    size_t key_offs = CACHE_ITEM_SIZE + align_cache(desc->value_size);
+    CacheShard *shard = &cache->shards[hash >> (64 - CACHE_SHARD_ORDER)];
+
+    ass_mutex_lock(&shard->lock);
+    CacheSlot *slot = find_slot(shard, desc, hash, key, compare_func);
+    CacheItem *item = slot->item;
+    if (item) {
+        shard->hits++;
+        while (!item->size)
+            ass_cond_wait(&shard->ready, &shard->lock);
+        void *value = touch_item(shard, item, cache->policy);
+        ass_mutex_unlock(&shard->lock);
         desc->key_move_func(NULL, key);
-        return NULL;
+        return value;
+    }
+    shard->misses++;
+
+    // keep the load factor at or below 3/4;
+    // an empty slot must remain in any case to terminate probing
+    if (4 * (shard->count + 1) > 3 * shard->capacity) {
+        if (shard_resize(shard, 2 * shard->capacity))
+            slot = find_slot(shard, desc, hash, key, compare_func);
+        else if (shard->count + 1 >= shard->capacity)
+            goto fail;
     }
-    item->cache = cache;
+
+    item = arena_alloc(shard->arena);
+    if (!item)
+        goto fail;
+    item->shard = shard;
+    item->arena = shard->arena;
     item->desc = desc;
+    item->hash = hash;
     void *new_key = (char *) item + key_offs;
     if (!desc->key_move_func(new_key, key)) {
-        free(item);
+        ass_mutex_unlock(&shard->lock);
+        arena_free(item->arena, item);
         return NULL;
     }
-    void *value = (char *) item + CACHE_ITEM_SIZE;
-    item->size = desc->construct_func(new_key, value, priv);
-    assert(item->size);
 
-    CacheItem **bucketptr = &cache->map[bucket];
-    if (*bucketptr)
-        (*bucketptr)->prev = &item->next;
-    item->prev = bucketptr;
-    item->next = *bucketptr;
-    *bucketptr = item;
-
-    *cache->queue_last = item;
-    item->queue_prev = cache->queue_last;
-    cache->queue_last = &item->queue_next;
-    item->queue_next = NULL;
+    // publish the key first so that other threads wait instead of
+    // constructing the same value, then construct without holding the lock
+    slot->hash = hash;
+    slot->item = item;
+    shard->count++;
+    item->queue = NULL;
+    item->span_start = LLONG_MAX;
+    item->span_end = LLONG_MIN;
+    item->size = 0;
     item->ref_count = 1;
+    ass_mutex_unlock(&shard->lock);
 
-    cache->cache_size += item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+    void *value = (char *) item + CACHE_ITEM_SIZE;
+    int64_t start = ass_time_ns();
+    size_t size = desc->construct_func(new_key, value, priv);
+    int64_t time = ass_time_ns() - start;
+    assert(size);
+
+    ass_mutex_lock(&shard->lock);
+    shard->constructions++;
+    shard->construct_time += time;
+    item->size = size;
+    queue_append(&shard->queue[QUEUE_PROBATION], item);
+    shard->cache_size += item_footprint(item);
+    shard->resident += item_resident(item);
+    ass_cond_broadcast(&shard->ready);
+    ass_mutex_unlock(&shard->lock);
     return value;
+
+fail:
+    ass_mutex_unlock(&shard->lock);
+    desc->key_move_func(NULL, key);
+    return NULL;
 }
 
-void *ass_cache_key(void *value)
+// Retrieve a value corresponding to a particular cache key,
+// creating one if it does not already exist.
+// The returned item is guaranteed to be valid until the next ass_cache_cut call;
+// to extend its lifetime further, call ass_cache_inc_ref().
+// Safe to call concurrently. Each value is constructed exactly once:
+// threads missing on a key that is already being constructed
+// wait for the construction to finish.
+void *ass_cache_get(Cache *cache, void *key, void *priv)
 {
-    CacheItem *item = value_to_item(value);
-    return (char *) value + align_cache(item->desc->value_size);
+    const CacheDesc *desc = cache->desc;
+    return cache_get(cache, key, priv,
+                     desc->hash_func(key, ASS_HASH_INIT), desc->compare_func);
 }
 
-static inline void destroy_item(const CacheDesc *desc, CacheItem *item)
+// Same as ass_cache_get(), specialized for each cache type
+#define CACHE_GET_FUNCTION(name, keytype) \
+    void *ass_cache_get_##name(Cache *cache, keytype *key, void *priv) \
+    { \
+        assert(cache->desc == &name##_cache_desc); \
+        return cache_get(cache, key, priv, \
+                         name##_hash(key, ASS_HASH_INIT), name##_compare); \
+    }
+
+CACHE_GET_FUNCTION(font, ASS_FontDesc)
+CACHE_GET_FUNCTION(outline, OutlineHashKey)
+CACHE_GET_FUNCTION(glyph_metrics, GlyphMetricsHashKey)
+CACHE_GET_FUNCTION(face_size_metrics, FaceSizeMetricsHashKey)
+CACHE_GET_FUNCTION(bitmap, BitmapHashKey)
+CACHE_GET_FUNCTION(composite, CompositeHashKey)
+
+#undef CACHE_GET_FUNCTION
+
+void *ass_cache_key(void *value)
 {
-    assert(item->desc == desc);
-    char *value = (char *) item + CACHE_ITEM_SIZE;
-    desc->destruct_func(value + align_cache(desc->value_size), value);
-    free(item);
+    CacheItem *item = value_to_item(value);
+    return (char *) value + align_cache(item->desc->value_size);
 }
 
 void ass_cache_inc_ref(void *value)
@@ -460,8 +845,8 @@ void ass_cache_inc_ref(void *value)
     if (!value)
         return;
     CacheItem *item = value_to_item(value);
-    assert(item->size && item->ref_count);
-    item->ref_count++;
+    assert(item->size && ass_atomic_load(&item->ref_count));
+    ass_atomic_add(&item->ref_count, 1);
 }
 
 void ass_cache_dec_ref(void *value)
@@ -469,78 +854,258 @@ void ass_cache_dec_ref(void *value)
     if (!value)
         return;
     CacheItem *item = value_to_item(value);
-    assert(item->size && item->ref_count);
-    if (--item->ref_count)
+    assert(item->size && ass_atomic_load(&item->ref_count));
+
+    // Dropping a reference other than the last one needs no lock.
+    // The last one is dropped under the shard lock, since a concurrent
+    // ass_cache_get() can still find the item and revive it.
+    size_t ref_count = ass_atomic_load(&item->ref_count);
+    while (ref_count > 1)
+        if (ass_atomic_cas(&item->ref_count, &ref_count, ref_count - 1))
+            return;
+
+    CacheShard *shard = item->shard;
+    if (shard) {
+        ass_mutex_lock(&shard->lock);
+        if (ass_atomic_sub(&item->ref_count, 1)) {
+            ass_mutex_unlock(&shard->lock);
+            return;
+        }
+        remove_item(shard, item);
+        ass_mutex_unlock(&shard->lock);
+    } else if (ass_atomic_sub(&item->ref_count, 1))
+        return;
+    destroy_item(item->desc, item);
+}
+
+// Size of a shard either in limit units or in bytes
+static inline size_t *shard_size(CacheShard *shard, bool resident)
+{
+    return resident ? &shard->resident : &shard->cache_size;
+}
+
+static size_t cache_size(Cache *cache, bool resident)
+{
+    size_t size = 0;
+    for (int i = 0; i < CACHE_SHARDS; i++)
+        size += *shard_size(&cache->shards[i], resident);
+    return size;
+}
+
+// Drop the queue reference of an item, destroying it if that was the last one
+static void evict_item(CacheShard *shard, const CacheDesc *desc, CacheItem *item)
+{
+    assert(item->size);
+    queue_unlink(item);
+    if (ass_atomic_sub(&item->ref_count, 1))
         return;
 
-    Cache *cache = item->cache;
-    if (cache) {
-        if (item->next)
-            item->next->prev = item->prev;
-        *item->prev = item->next;
+    remove_item(shard, item);
+    destroy_item(desc, item);
+}
 
-        cache->cache_size -= item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+// Evict items not needed by any event from now until now + lookahead
+// in least recently used order, until at most max_free has been freed
+static size_t shard_cut_timeline(CacheShard *shard, const Cache *cache,
+                                 size_t max_free, bool resident)
+{
+    size_t *size = shard_size(shard, resident);
+    size_t min_size = *size - FFMIN(*size, max_free);
+    long long now = cache->now, lookahead = cache->lookahead;
+    long long until = now > LLONG_MAX - lookahead ? LLONG_MAX : now + lookahead;
+
+    size_t prev_size = *size;
+    for (int i = 0; i < QUEUE_COUNT && *size > min_size; i++) {
+        CacheItem *item = shard->queue[i].first;
+        while (item && *size > min_size) {
+            // queued items are referenced, so the next one
+            // cannot be destroyed as a side effect of evicting this one
+            CacheItem *next = item->queue_next;
+            if (item->span_start <= item->span_end &&
+                    (item->span_end < now || item->span_start > until))
+                evict_item(shard, cache->desc, item);
+            item = next;
+        }
     }
-    destroy_item(item->desc, item);
+    return prev_size - *size;
 }
 
-void ass_cache_cut(Cache *cache, size_t max_size)
+static void shard_cut(CacheShard *shard, const Cache *cache,
+                      size_t max_size, bool resident)
 {
-    if (cache->cache_size <= max_size)
+    size_t *size = shard_size(shard, resident);
+    if (*size <= max_size)
         return;
 
+    // demote the least recently used protected items back to probation;
+    // everything is demoted after switching back to plain LRU.
+    // Queue sizes are footprints, so scale the limit accordingly.
+    CacheQueue *probation = &shard->queue[QUEUE_PROBATION];
+    CacheQueue *protected = &shard->queue[QUEUE_PROTECTED];
+    size_t protected_max = 0;
+    if (cache->policy == ASS_CACHE_POLICY_SLRU)
+        protected_max = (double) shard->cache_size * max_size / *size *
+            CACHE_PROTECTED_SHARE / 100;
+    while (protected->size > protected_max) {
+        CacheItem *item = protected->first;
+        queue_unlink(item);
+        queue_append(probation, item);
+    }
+
     do {
-        CacheItem *item = cache->queue_first;
+        CacheItem *item = probation->first;
+        if (!item)
+            item = protected->first;
         if (!item)
             break;
-        assert(item->size);
+        evict_item(shard, cache->desc, item);
+    } while (*size > max_size);
+}
 
-        cache->queue_first = item->queue_next;
-        if (--item->ref_count) {
-            item->queue_prev = NULL;
-            continue;
+// Give back memory after large evictions; failure is harmless
+static void shard_shrink(CacheShard *shard)
+{
+    size_t capacity = shard->capacity;
+    while (capacity > CACHE_MIN_CAPACITY && 8 * shard->count < capacity)
+        capacity /= 2;
+    if (capacity != shard->capacity)
+        shard_resize(shard, capacity);
+}
+
+// ass_cache_cut() and ass_cache_empty() must not run concurrently with any
+// other operation on the same cache: destructors release references to items
+// of the same cache, so the shard locks cannot be held while destroying items.
+// Items outside of the timeline window go first, from any shard;
+// after that each shard is cut proportionally to its share of the total size.
+static void cache_cut(Cache *cache, size_t max_size, bool resident)
+{
+    size_t total = cache_size(cache, resident);
+    if (total <= max_size)
+        return;
+
+    if (cache->lookahead >= 0) {
+        for (int i = 0; i < CACHE_SHARDS && total > max_size; i++)
+            total -= shard_cut_timeline(&cache->shards[i], cache,
+                                        total - max_size, resident);
+        total = cache_size(cache, resident);
+    }
+
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        if (total > max_size) {
+            size_t share = (double) *shard_size(shard, resident) * max_size / total;
+            shard_cut(shard, cache, share, resident);
         }
+        shard_shrink(shard);
+    }
+}
+
+// Cut to a limit in the units returned by the value constructors
+void ass_cache_cut(Cache *cache, size_t max_size)
+{
+    cache_cut(cache, max_size, false);
+}
 
-        if (item->next)
-            item->next->prev = item->prev;
-        *item->prev = item->next;
+// Cut to a limit on the approximate memory use in bytes
+void ass_cache_cut_resident(Cache *cache, size_t max_bytes)
+{
+    cache_cut(cache, max_bytes, true);
+}
 
-        cache->cache_size -= item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
-        destroy_item(cache->desc, item);
-    } while (cache->cache_size > max_size);
-    if (cache->queue_first)
-        cache->queue_first->queue_prev = &cache->queue_first;
-    else
-        cache->queue_last = &cache->queue_first;
+// Select the eviction policy used by subsequent ass_cache_get() and
+// ass_cache_cut() calls; must not run concurrently with them
+void ass_cache_set_policy(Cache *cache, ASS_CachePolicy policy)
+{
+    cache->policy = policy;
+}
+
+// Make subsequent cuts evict items tagged only with events outside
+// of [now, now + lookahead] first; negative lookahead disables that
+void ass_cache_set_time(Cache *cache, long long now, long long lookahead)
+{
+    cache->now = now;
+    cache->lookahead = lookahead;
+}
+
+// Record that the value is used by an event displayed from start to end
+void ass_cache_tag(void *value, long long start, long long end)
+{
+    CacheItem *item = value_to_item(value);
+    CacheShard *shard = item->shard;
+    if (!shard)
+        return;
+    ass_mutex_lock(&shard->lock);
+    item->span_start = FFMIN(item->span_start, start);
+    item->span_end = FFMAX(item->span_end, end);
+    ass_mutex_unlock(&shard->lock);
+}
+
+void ass_cache_get_stats(Cache *cache, ASS_CacheCounters *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        ass_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->constructions += shard->constructions;
+        stats->evictions += shard->evictions;
+        stats->construct_time += shard->construct_time;
+        stats->bytes += shard->resident;
+        stats->items += shard->count;
+        ass_mutex_unlock(&shard->lock);
+    }
+    stats->lookups = stats->hits + stats->misses;
 }
 
 void ass_cache_empty(Cache *cache)
 {
-    for (int i = 0; i < cache->buckets; i++) {
-        CacheItem *item = cache->map[i];
-        while (item) {
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+
+        // orphan everything first, so that releasing references below
+        // never modifies the table; items still referenced from outside
+        // stay alive until their last reference is dropped
+        for (size_t j = 0; j < shard->capacity; j++) {
+            CacheItem *item = shard->slots[j].item;
+            if (!item)
+                continue;
             assert(item->size);
-            CacheItem *next = item->next;
-            if (item->queue_prev)
-                item->ref_count--;
-            if (item->ref_count)
-                item->cache = NULL;
-            else
-                destroy_item(cache->desc, item);
-            item = next;
+            item->shard = NULL;
+        }
+
+        // then drop the references held by the queues;
+        // the rest of the queues stays referenced while doing so
+        for (int k = 0; k < QUEUE_COUNT; k++) {
+            CacheQueue *queue = &shard->queue[k];
+            CacheItem *item = queue->first;
+            while (item) {
+                CacheItem *next = item->queue_next;
+                item->queue = NULL;
+                if (!--item->ref_count)
+                    destroy_item(cache->desc, item);
+                item = next;
+            }
+            queue->first = NULL;
+            queue->last = &queue->first;
+            queue->size = 0;
         }
-        cache->map[i] = NULL;
-    }
 
-    cache->queue_first = NULL;
-    cache->queue_last = &cache->queue_first;
-    cache->cache_size = 0;
+        shard->cache_size = 0;
+        shard->resident = 0;
+        shard->count = 0;
+        memset(shard->slots, 0, shard->capacity * sizeof(CacheSlot));
+        if (shard->capacity > CACHE_MIN_CAPACITY)
+            shard_resize(shard, CACHE_MIN_CAPACITY);
+        arena_trim(shard->arena, false);
+    }
 }
 
 void ass_cache_done(Cache *cache)
 {
     ass_cache_empty(cache);
-    free(cache->map);
+    for (int i = 0; i < CACHE_SHARDS; i++)
+        shard_done(&cache->shards[i]);
     free(cache);
 }
 
@@ -28,6 +28,12 @@
 typedef struct cache Cache;
 typedef uint64_t ass_hashcode;
 
+// Identity of a value that stays valid across processes,
+// see ass_disk_cache.h
+typedef struct {
+    uint64_t hash[2];
+} DiskCacheKey;
+
 // cache values
 
 typedef struct {
@@ -40,6 +46,8 @@ typedef struct {
     ASS_Rect cbox;  // bounding box of all control points
     int advance;    // 26.6, advance distance to the next outline in line
     int asc, desc;  // ascender/descender
+    bool has_disk_key;  // only computed while a disk cache is in use
+    DiskCacheKey disk_key;
 } OutlineHashValue;
 
 // Create definitions for bitmap, outline and composite hash keys
@@ -100,10 +108,21 @@ typedef struct
 
 Cache *ass_cache_create(const CacheDesc *desc);
 void *ass_cache_get(Cache *cache, void *key, void *priv);
+void *ass_cache_get_font(Cache *cache, ASS_FontDesc *key, void *priv);
+void *ass_cache_get_outline(Cache *cache, OutlineHashKey *key, void *priv);
+void *ass_cache_get_glyph_metrics(Cache *cache, GlyphMetricsHashKey *key, void *priv);
+void *ass_cache_get_face_size_metrics(Cache *cache, FaceSizeMetricsHashKey *key, void *priv);
+void *ass_cache_get_bitmap(Cache *cache, BitmapHashKey *key, void *priv);
+void *ass_cache_get_composite(Cache *cache, CompositeHashKey *key, void *priv);
 void *ass_cache_key(void *value);
 void ass_cache_inc_ref(void *value);
 void ass_cache_dec_ref(void *value);
 void ass_cache_cut(Cache *cache, size_t max_size);
+void ass_cache_cut_resident(Cache *cache, size_t max_bytes);
+void ass_cache_set_policy(Cache *cache, ASS_CachePolicy policy);
+void ass_cache_get_stats(Cache *cache, ASS_CacheCounters *stats);
+void ass_cache_set_time(Cache *cache, long long now, long long lookahead);
+void ass_cache_tag(void *value, long long start, long long end);
 void ass_cache_empty(Cache *cache);
 void ass_cache_done(Cache *cache);
 Cache *ass_font_cache_create(void);
@@ -14,7 +14,7 @@
 #elif defined(CREATE_COMPARISON_FUNCTIONS)
 #undef CREATE_COMPARISON_FUNCTIONS
 #define START(funcname, structname) \
-    static bool funcname##_compare(void *key1, void *key2) \
+    static inline bool funcname##_compare(void *key1, void *key2) \
     { \
         struct structname *a = key1; \
         struct structname *b = key2; \
@@ -31,17 +31,22 @@
 
 #elif defined(CREATE_HASH_FUNCTIONS)
 #undef CREATE_HASH_FUNCTIONS
+// fixed-size members are gathered into a padding-free buffer
+// and hashed in a single pass of constant length
 #define START(funcname, structname) \
-    static ass_hashcode funcname##_hash(void *buf, ass_hashcode hval) \
+    static inline ass_hashcode funcname##_hash(void *buf, ass_hashcode hval) \
     { \
-        struct structname *p = buf;
+        struct structname *p = buf; \
+        char packed[sizeof(struct structname)]; \
+        size_t len = 0;
 #define GENERIC(type, member) \
-        hval = ass_hash_buf(&p->member, sizeof(p->member), hval);
+        memcpy(packed + len, &p->member, sizeof(p->member)); \
+        len += sizeof(p->member);
 #define STRING(member) \
         hval = ass_hash_buf(p->member.str, p->member.len, hval);
-#define VECTOR(member) GENERIC(, member.x); GENERIC(, member.y);
+#define VECTOR(member) GENERIC(, member.x) GENERIC(, member.y)
 #define END(typedefname) \
-        return hval; \
+        return ass_hash_buf(packed, len, hval); \
     }
 
 #else
@@ -66,6 +71,7 @@ START(bitmap, bitmap_hash_key)
     VECTOR(matrix_x)
     VECTOR(matrix_y)
     VECTOR(matrix_z)
+    GENERIC(bool, sparse)  // allow sparse form, for vector clips
 END(BitmapHashKey)
 
 // font is refed when inserted and unrefed when dropped
@@ -120,6 +126,7 @@ START(filter, filter_desc)
     GENERIC(int, blur_x)
     GENERIC(int, blur_y)
     VECTOR(shadow)
+    VECTOR(offset)  // subpixel shift of the result, 26.6
 END(FilterDesc)
 
 // describes glyph bitmap reference
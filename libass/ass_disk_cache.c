@@ -0,0 +1,728 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ft2build.h>
+#include FT_TRUETYPE_TABLES_H
+
+#ifdef _WIN32
+#include <windows.h>
+#elif HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ass_disk_cache.h"
+#include "ass_filesystem.h"
+#include "ass_threading.h"
+#include "ass_utils.h"
+
+#define WYHASH_LITTLE_ENDIAN 1
+#include "wyhash.h"
+
+
+/*
+ * File layout, all in native byte order:
+ *   DiskCacheHeader
+ *   DiskCacheEntry[n_entries], sorted by key
+ *   records, each starting at a multiple of 8 bytes
+ */
+
+#define DISK_CACHE_MAGIC "libassDC"
+// increment whenever the file format or rasterization output changes,
+// files of other versions are ignored
+#define DISK_CACHE_VERSION 2
+#define DISK_CACHE_BYTE_ORDER 0x01020304
+
+// memory limit for values collected by a single process
+#define DISK_CACHE_MAX_ADDED ((size_t) 256 << 20)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t libass_version;
+    uint32_t freetype_version;
+    uint64_t file_size;
+    uint64_t n_entries;
+} DiskCacheHeader;
+
+typedef struct {
+    uint64_t key[2];
+    uint64_t offset, size;
+} DiskCacheEntry;
+
+// followed by points and segments of both outlines
+typedef struct {
+    int32_t advance, asc, desc;
+    ASS_Rect cbox;
+    uint32_t n_points[2], n_segments[2];
+} OutlineRecord;
+
+// followed by h rows of w bytes
+typedef struct {
+    int32_t left, top, w, h;
+} BitmapRecord;
+
+typedef struct {
+    DiskCacheKey key;
+    uint8_t *data;
+    size_t size;
+} AddedRecord;
+
+struct disk_cache {
+    ASS_Library *library;
+    char *path;
+    uint32_t freetype_version;
+
+    // file written by a previous process, read-only
+    uint8_t *data;
+    size_t size;
+    bool mapped;
+    const DiskCacheEntry *entries;
+    size_t n_entries;
+
+    // records constructed by this process, written out on save
+    ASS_Mutex lock;
+    AddedRecord *added;
+    size_t n_added, max_added;
+    size_t added_size;
+};
+
+
+// Key construction
+
+enum {
+    DISK_KEY_OUTLINE = 1,
+    DISK_KEY_BITMAP,
+};
+
+static void key_add(DiskCacheKey *key, const void *data, size_t size)
+{
+    key->hash[0] = wyhash(data, size, key->hash[0], _wyp);
+    key->hash[1] = wyhash(data, size, key->hash[1], _wyp);
+}
+
+#define KEY_ADD(key, member) key_add(key, &(member), sizeof(member))
+
+static void key_init(DiskCacheKey *key, int type)
+{
+    key->hash[0] = 0x6c6962617373ULL;
+    key->hash[1] = 0xa0761d6478bd642fULL;
+    KEY_ADD(key, type);
+}
+
+static void key_add_string(DiskCacheKey *key, const char *str, size_t len)
+{
+    KEY_ADD(key, len);
+    key_add(key, str, len);
+}
+
+static void key_add_cstring(DiskCacheKey *key, const char *str)
+{
+    key_add_string(key, str ? str : "", str ? strlen(str) : 0);
+}
+
+// Faces are identified by their contents rather than by file name,
+// so that replaced or updated font files never match stale records
+static void key_add_face(DiskCacheKey *key, FT_Face face)
+{
+    KEY_ADD(key, face->face_index);
+    KEY_ADD(key, face->num_glyphs);
+    KEY_ADD(key, face->face_flags);
+    KEY_ADD(key, face->style_flags);
+    KEY_ADD(key, face->units_per_EM);
+    key_add_cstring(key, face->family_name);
+    key_add_cstring(key, face->style_name);
+    key_add_cstring(key, FT_Get_Postscript_Name(face));
+    unsigned long size = face->stream ? face->stream->size : 0;
+    KEY_ADD(key, size);
+
+    TT_Header *head = FT_Get_Sfnt_Table(face, FT_SFNT_HEAD);
+    if (head) {
+        KEY_ADD(key, head->Font_Revision);
+        KEY_ADD(key, head->CheckSum_Adjust);
+        KEY_ADD(key, head->Created);
+        KEY_ADD(key, head->Modified);
+    }
+}
+
+bool ass_disk_cache_outline_key(DiskCacheKey *dst, OutlineHashKey *key,
+                                ASS_Hinting hinting)
+{
+    key_init(dst, DISK_KEY_OUTLINE);
+    int type = key->type;
+    KEY_ADD(dst, type);
+    switch (key->type) {
+    case OUTLINE_GLYPH:
+        {
+            GlyphHashKey *k = &key->u.glyph;
+            key_add_face(dst, k->font->faces[k->face_index]);
+            KEY_ADD(dst, k->font->desc.bold);
+            KEY_ADD(dst, k->font->desc.italic);
+            KEY_ADD(dst, k->font->desc.vertical);
+            KEY_ADD(dst, k->size);
+            KEY_ADD(dst, k->glyph_index);
+            KEY_ADD(dst, k->bold);
+            KEY_ADD(dst, k->italic);
+            KEY_ADD(dst, k->flags);
+            KEY_ADD(dst, hinting);
+            break;
+        }
+    case OUTLINE_DRAWING:
+        key_add_string(dst, key->u.drawing.text.str, key->u.drawing.text.len);
+        break;
+    case OUTLINE_BORDER:
+        {
+            BorderHashKey *k = &key->u.border;
+            if (!k->outline->has_disk_key)
+                return false;
+            KEY_ADD(dst, k->outline->disk_key);
+            KEY_ADD(dst, k->scale_ord_x);
+            KEY_ADD(dst, k->scale_ord_y);
+            KEY_ADD(dst, k->border);
+            break;
+        }
+    default:
+        break;
+    }
+    return true;
+}
+
+bool ass_disk_cache_bitmap_key(DiskCacheKey *dst, BitmapHashKey *key,
+                               ASS_TileSize tile_size)
+{
+    if (!key->outline->has_disk_key)
+        return false;
+    key_init(dst, DISK_KEY_BITMAP);
+    KEY_ADD(dst, key->outline->disk_key);
+    KEY_ADD(dst, key->offset);
+    KEY_ADD(dst, key->matrix_x);
+    KEY_ADD(dst, key->matrix_y);
+    KEY_ADD(dst, key->matrix_z);
+    KEY_ADD(dst, tile_size);
+    return true;
+}
+
+
+// File access
+
+static uint32_t get_freetype_version(FT_Library ftlibrary)
+{
+    FT_Int major, minor, patch;
+    FT_Library_Version(ftlibrary, &major, &minor, &patch);
+    return (uint32_t) major << 16 | (uint32_t) minor << 8 | (uint32_t) patch;
+}
+
+static bool map_file(DiskCache *cache)
+{
+#if HAVE_MMAP && !defined(_WIN32)
+    int fd = open(cache->path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size > 0 && st.st_size <= SIZE_MAX)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    cache->data = data;
+    cache->size = st.st_size;
+    cache->mapped = true;
+    return true;
+#else
+    FILE *fp = ass_open_file(cache->path, FN_EXTERNAL);
+    if (!fp)
+        return false;
+    long size = -1;
+    if (!fseek(fp, 0, SEEK_END))
+        size = ftell(fp);
+    uint8_t *data = NULL;
+    if (size > 0 && !fseek(fp, 0, SEEK_SET)) {
+        data = malloc(size);
+        if (data && fread(data, 1, size, fp) != (size_t) size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(fp);
+    if (!data)
+        return false;
+    cache->data = data;
+    cache->size = size;
+    cache->mapped = false;
+    return true;
+#endif
+}
+
+static void unmap_file(DiskCache *cache)
+{
+    if (!cache->data)
+        return;
+#if HAVE_MMAP && !defined(_WIN32)
+    if (cache->mapped)
+        munmap(cache->data, cache->size);
+    else
+        free(cache->data);
+#else
+    free(cache->data);
+#endif
+    cache->data = NULL;
+    cache->size = 0;
+    cache->entries = NULL;
+    cache->n_entries = 0;
+}
+
+static int compare_keys(const uint64_t a[2], const uint64_t b[2])
+{
+    if (a[0] != b[0])
+        return a[0] < b[0] ? -1 : 1;
+    if (a[1] != b[1])
+        return a[1] < b[1] ? -1 : 1;
+    return 0;
+}
+
+static bool check_file(DiskCache *cache)
+{
+    DiskCacheHeader header;
+    if (cache->size < sizeof(header))
+        return false;
+    memcpy(&header, cache->data, sizeof(header));
+    if (memcmp(header.magic, DISK_CACHE_MAGIC, sizeof(header.magic)) ||
+            header.version != DISK_CACHE_VERSION ||
+            header.byte_order != DISK_CACHE_BYTE_ORDER ||
+            header.libass_version != LIBASS_VERSION ||
+            header.freetype_version != cache->freetype_version ||
+            header.file_size != cache->size)
+        return false;
+    size_t max_entries = (cache->size - sizeof(header)) / sizeof(DiskCacheEntry);
+    if (header.n_entries > max_entries)
+        return false;
+
+    // validate once, so that lookups can trust the index
+    const DiskCacheEntry *entries = (const DiskCacheEntry *) (cache->data + sizeof(header));
+    for (size_t i = 0; i < header.n_entries; i++) {
+        if (entries[i].offset > cache->size ||
+                entries[i].size > cache->size - entries[i].offset)
+            return false;
+        if (i && compare_keys(entries[i - 1].key, entries[i].key) >= 0)
+            return false;
+    }
+    cache->entries = entries;
+    cache->n_entries = header.n_entries;
+    return true;
+}
+
+DiskCache *ass_disk_cache_open(ASS_Library *library, FT_Library ftlibrary,
+                               const char *path)
+{
+    DiskCache *cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        return NULL;
+    cache->library = library;
+    cache->freetype_version = get_freetype_version(ftlibrary);
+    cache->path = strdup(path);
+    if (!cache->path)
+        goto fail;
+    if (!ass_mutex_init(&cache->lock))
+        goto fail;
+
+    // a missing or stale file is not an error: it gets replaced on save
+    if (map_file(cache) && !check_file(cache)) {
+        ass_msg(library, MSGL_INFO, "Ignoring stale disk cache '%s'", path);
+        unmap_file(cache);
+    }
+    return cache;
+
+fail:
+    free(cache->path);
+    free(cache);
+    return NULL;
+}
+
+void ass_disk_cache_close(DiskCache *cache)
+{
+    if (!cache)
+        return;
+    unmap_file(cache);
+    for (size_t i = 0; i < cache->n_added; i++)
+        free(cache->added[i].data);
+    free(cache->added);
+    ass_mutex_destroy(&cache->lock);
+    free(cache->path);
+    free(cache);
+}
+
+static int compare_added(const void *a, const void *b)
+{
+    return compare_keys(((const AddedRecord *) a)->key.hash,
+                        ((const AddedRecord *) b)->key.hash);
+}
+
+static const uint8_t *find_record(DiskCache *cache, const DiskCacheKey *key,
+                                  size_t *size)
+{
+    size_t lo = 0, hi = cache->n_entries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const DiskCacheEntry *entry = &cache->entries[mid];
+        int cmp = compare_keys(key->hash, entry->key);
+        if (cmp > 0) {
+            lo = mid + 1;
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            *size = entry->size;
+            return cache->data + entry->offset;
+        }
+    }
+    return NULL;
+}
+
+static bool write_padding(FILE *fp, uint64_t *pos)
+{
+    static const char zero[8] = {0};
+    size_t pad = -*pos & 7;
+    *pos += pad;
+    return fwrite(zero, 1, pad, fp) == pad;
+}
+
+static bool write_file(DiskCache *cache, FILE *fp)
+{
+    // merge records of the old file with the new ones,
+    // both sorted and free of duplicates
+    size_t n_old = cache->n_entries, n_new = cache->n_added;
+    size_t n_entries = 0;
+    for (size_t i = 0, j = 0; i < n_old || j < n_new; n_entries++) {
+        int cmp = i == n_old ? 1 : j == n_new ? -1 :
+            compare_keys(cache->entries[i].key, cache->added[j].key.hash);
+        i += cmp <= 0;
+        j += cmp >= 0;
+    }
+
+    DiskCacheHeader header = {0};
+    memcpy(header.magic, DISK_CACHE_MAGIC, sizeof(header.magic));
+    header.version = DISK_CACHE_VERSION;
+    header.byte_order = DISK_CACHE_BYTE_ORDER;
+    header.libass_version = LIBASS_VERSION;
+    header.freetype_version = cache->freetype_version;
+    header.n_entries = n_entries;
+
+    // entries first, so that all offsets are known up front
+    uint64_t pos = sizeof(header) + n_entries * sizeof(DiskCacheEntry);
+    if (fseek(fp, sizeof(header), SEEK_SET))
+        return false;
+    for (size_t i = 0, j = 0; i < n_old || j < n_new;) {
+        int cmp = i == n_old ? 1 : j == n_new ? -1 :
+            compare_keys(cache->entries[i].key, cache->added[j].key.hash);
+        DiskCacheEntry entry;
+        if (cmp <= 0) {
+            memcpy(&entry, &cache->entries[i], sizeof(entry));
+        } else {
+            entry.key[0] = cache->added[j].key.hash[0];
+            entry.key[1] = cache->added[j].key.hash[1];
+            entry.size = cache->added[j].size;
+        }
+        i += cmp <= 0;
+        j += cmp >= 0;
+        pos += -pos & 7;
+        entry.offset = pos;
+        pos += entry.size;
+        if (fwrite(&entry, sizeof(entry), 1, fp) != 1)
+            return false;
+    }
+
+    pos = sizeof(header) + n_entries * sizeof(DiskCacheEntry);
+    for (size_t i = 0, j = 0; i < n_old || j < n_new;) {
+        int cmp = i == n_old ? 1 : j == n_new ? -1 :
+            compare_keys(cache->entries[i].key, cache->added[j].key.hash);
+        const uint8_t *data;
+        size_t size;
+        if (cmp <= 0) {
+            data = cache->data + cache->entries[i].offset;
+            size = cache->entries[i].size;
+        } else {
+            data = cache->added[j].data;
+            size = cache->added[j].size;
+        }
+        i += cmp <= 0;
+        j += cmp >= 0;
+        if (!write_padding(fp, &pos) || fwrite(data, 1, size, fp) != size)
+            return false;
+        pos += size;
+    }
+
+    header.file_size = pos;
+    return !fseek(fp, 0, SEEK_SET) && fwrite(&header, sizeof(header), 1, fp) == 1;
+}
+
+static bool replace_file(const char *src, const char *dst)
+{
+#ifdef _WIN32
+    return MoveFileExA(src, dst, MOVEFILE_REPLACE_EXISTING);
+#else
+    return !rename(src, dst);
+#endif
+}
+
+/**
+ * \brief Write all known records to the cache file.
+ * The new file is written under a temporary name and renamed over the old
+ * one, so concurrent readers keep their view of the old file. If several
+ * processes save the same file, the last one wins.
+ * Must not run concurrently with any other function on the same cache.
+ */
+bool ass_disk_cache_save(DiskCache *cache)
+{
+    if (!cache->n_added)
+        return true;
+
+    qsort(cache->added, cache->n_added, sizeof(*cache->added), compare_added);
+    size_t n = 0;
+    for (size_t i = 0; i < cache->n_added; i++) {
+        if (n && !compare_added(&cache->added[n - 1], &cache->added[i])) {
+            free(cache->added[i].data);
+            continue;
+        }
+        cache->added[n++] = cache->added[i];
+    }
+    cache->n_added = n;
+
+    size_t len = strlen(cache->path) + 32;
+    char *tmp = malloc(len);
+    if (!tmp)
+        return false;
+    snprintf(tmp, len, "%s.%016" PRIx64 ".tmp", cache->path,
+             (uint64_t) ass_time_ns() ^ (uintptr_t) cache);
+
+    bool ok = false;
+    FILE *fp = fopen(tmp, "wb");
+    if (fp) {
+        ok = write_file(cache, fp);
+        ok = !fclose(fp) && ok;
+        ok = ok && replace_file(tmp, cache->path);
+        if (!ok)
+            remove(tmp);
+    }
+    if (!ok)
+        ass_msg(cache->library, MSGL_WARN,
+                "Failed to write disk cache '%s'", cache->path);
+    free(tmp);
+    return ok;
+}
+
+
+// Record serialization
+
+static void add_record(DiskCache *cache, const DiskCacheKey *key,
+                       uint8_t *data, size_t size)
+{
+    ass_mutex_lock(&cache->lock);
+    if (cache->added_size + size > DISK_CACHE_MAX_ADDED)
+        goto fail;
+    if (cache->n_added == cache->max_added) {
+        size_t max = FFMAX(2 * cache->max_added, 64);
+        AddedRecord *added = ass_try_realloc_array(cache->added, max, sizeof(*added));
+        if (!added)
+            goto fail;
+        cache->added = added;
+        cache->max_added = max;
+    }
+    AddedRecord *rec = &cache->added[cache->n_added++];
+    rec->key = *key;
+    rec->data = data;
+    rec->size = size;
+    cache->added_size += size;
+    ass_mutex_unlock(&cache->lock);
+    return;
+
+fail:
+    ass_mutex_unlock(&cache->lock);
+    free(data);
+}
+
+// Corrupt records must not reach the rasterizer, so check the invariants
+// documented in ass_outline.h
+static bool check_outline(const ASS_Outline *outline)
+{
+    size_t n_points = 0;
+    for (size_t i = 0; i < outline->n_segments; i++) {
+        int order = outline->segments[i] & OUTLINE_COUNT_MASK;
+        if (!order || (outline->segments[i] & ~(OUTLINE_COUNT_MASK | OUTLINE_CONTOUR_END)))
+            return false;
+        n_points += order;
+    }
+    if (n_points != outline->n_points)
+        return false;
+    if (outline->n_segments &&
+            !(outline->segments[outline->n_segments - 1] & OUTLINE_CONTOUR_END))
+        return false;
+    for (size_t i = 0; i < outline->n_points; i++)
+        if (abs(outline->points[i].x) > OUTLINE_MAX ||
+                abs(outline->points[i].y) > OUTLINE_MAX)
+            return false;
+    return true;
+}
+
+bool ass_disk_cache_load_outline(DiskCache *cache, const DiskCacheKey *key,
+                                 OutlineHashValue *value)
+{
+    size_t size;
+    const uint8_t *data = find_record(cache, key, &size);
+    OutlineRecord rec;
+    if (!data || size < sizeof(rec))
+        return false;
+    memcpy(&rec, data, sizeof(rec));
+    data += sizeof(rec);
+    size -= sizeof(rec);
+
+    for (int i = 0; i < 2; i++) {
+        ASS_Outline *outline = &value->outline[i];
+        size_t n_points = rec.n_points[i], n_segments = rec.n_segments[i];
+        if (n_points > size / sizeof(ASS_Vector) ||
+                n_segments > size - n_points * sizeof(ASS_Vector))
+            goto fail;
+        if (!n_points || !n_segments) {
+            if (n_points || n_segments)
+                goto fail;
+            ass_outline_clear(outline);
+            continue;
+        }
+        if (!ass_outline_alloc(outline, n_points, n_segments))
+            goto fail;
+        memcpy(outline->points, data, n_points * sizeof(ASS_Vector));
+        data += n_points * sizeof(ASS_Vector);
+        memcpy(outline->segments, data, n_segments);
+        data += n_segments;
+        size -= n_points * sizeof(ASS_Vector) + n_segments;
+        outline->n_points = n_points;
+        outline->n_segments = n_segments;
+        if (!check_outline(outline))
+            goto fail;
+    }
+
+    value->valid = true;
+    value->advance = rec.advance;
+    value->asc = rec.asc;
+    value->desc = rec.desc;
+    value->cbox = rec.cbox;
+    return true;
+
+fail:
+    ass_outline_free(&value->outline[0]);
+    ass_outline_free(&value->outline[1]);
+    return false;
+}
+
+void ass_disk_cache_store_outline(DiskCache *cache, const DiskCacheKey *key,
+                                  const OutlineHashValue *value)
+{
+    if (!value->valid)
+        return;
+
+    OutlineRecord rec;
+    size_t size = sizeof(rec);
+    for (int i = 0; i < 2; i++) {
+        const ASS_Outline *outline = &value->outline[i];
+        rec.n_points[i] = outline->n_points;
+        rec.n_segments[i] = outline->n_segments;
+        size += outline->n_points * sizeof(ASS_Vector) + outline->n_segments;
+    }
+    rec.advance = value->advance;
+    rec.asc = value->asc;
+    rec.desc = value->desc;
+    rec.cbox = value->cbox;
+
+    uint8_t *data = malloc(size);
+    if (!data)
+        return;
+    uint8_t *ptr = data;
+    memcpy(ptr, &rec, sizeof(rec));
+    ptr += sizeof(rec);
+    for (int i = 0; i < 2; i++) {
+        const ASS_Outline *outline = &value->outline[i];
+        if (!outline->n_points)
+            continue;
+        memcpy(ptr, outline->points, outline->n_points * sizeof(ASS_Vector));
+        ptr += outline->n_points * sizeof(ASS_Vector);
+        memcpy(ptr, outline->segments, outline->n_segments);
+        ptr += outline->n_segments;
+    }
+    add_record(cache, key, data, size);
+}
+
+bool ass_disk_cache_load_bitmap(DiskCache *cache, const DiskCacheKey *key,
+                                const BitmapEngine *engine, Bitmap *bm)
+{
+    size_t size;
+    const uint8_t *data = find_record(cache, key, &size);
+    BitmapRecord rec;
+    if (!data || size < sizeof(rec))
+        return false;
+    memcpy(&rec, data, sizeof(rec));
+    data += sizeof(rec);
+    size -= sizeof(rec);
+
+    memset(bm, 0, sizeof(*bm));
+    if (!rec.w || !rec.h)
+        return true;  // empty bitmap
+    if (rec.w < 0 || rec.h < 0 || (size_t) rec.w > size / rec.h ||
+            (size_t) rec.w * rec.h != size)
+        return false;
+    // stride padding must be zero like in freshly rasterized bitmaps
+    if (!ass_alloc_bitmap(engine, bm, rec.w, rec.h, true))
+        return false;
+    bm->left = rec.left;
+    bm->top = rec.top;
+    for (int32_t y = 0; y < rec.h; y++) {
+        memcpy(bm->buffer + y * bm->stride, data, rec.w);
+        data += rec.w;
+    }
+    return true;
+}
+
+void ass_disk_cache_store_bitmap(DiskCache *cache, const DiskCacheKey *key,
+                                 const Bitmap *bm)
+{
+    BitmapRecord rec = {0};
+    if (bm->buffer) {
+        rec.left = bm->left;
+        rec.top = bm->top;
+        rec.w = bm->w;
+        rec.h = bm->h;
+    }
+
+    size_t size = sizeof(rec) + (size_t) rec.w * rec.h;
+    uint8_t *data = malloc(size);
+    if (!data)
+        return;
+    memcpy(data, &rec, sizeof(rec));
+    for (int32_t y = 0; y < rec.h; y++)
+        memcpy(data + sizeof(rec) + (size_t) y * rec.w,
+               bm->buffer + y * bm->stride, rec.w);
+    add_record(cache, key, data, size);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_DISK_CACHE_H
+#define LIBASS_DISK_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ass_font.h"
+#include "ass_cache.h"
+#include "ass_bitmap.h"
+
+// Persistent cache of outlines and bitmaps shared between processes.
+// Values are identified by DiskCacheKey, a hash of everything they depend on
+// (with font files identified by their contents) instead of the pointer-based
+// keys of the in-memory caches. The file written by ass_disk_cache_save()
+// is mapped read-only by later processes; it is replaced atomically,
+// so readers never see a partial file. Files written by another version
+// of libass or FreeType are ignored.
+
+typedef struct disk_cache DiskCache;
+
+DiskCache *ass_disk_cache_open(ASS_Library *library, FT_Library ftlibrary,
+                               const char *path);
+bool ass_disk_cache_save(DiskCache *cache);
+void ass_disk_cache_close(DiskCache *cache);
+
+// Keys can't be computed for values derived from outlines
+// that were constructed without a disk cache, false is returned then.
+bool ass_disk_cache_outline_key(DiskCacheKey *dst, OutlineHashKey *key,
+                                ASS_Hinting hinting);
+bool ass_disk_cache_bitmap_key(DiskCacheKey *dst, BitmapHashKey *key,
+                               ASS_TileSize tile_size);
+
+// Lookups are lock-free and may run concurrently with everything but
+// ass_disk_cache_save() and ass_disk_cache_close().
+bool ass_disk_cache_load_outline(DiskCache *cache, const DiskCacheKey *key,
+                                 OutlineHashValue *value);
+bool ass_disk_cache_load_bitmap(DiskCache *cache, const DiskCacheKey *key,
+                                const BitmapEngine *engine, Bitmap *bm);
+void ass_disk_cache_store_outline(DiskCache *cache, const DiskCacheKey *key,
+                                  const OutlineHashValue *value);
+void ass_disk_cache_store_bitmap(DiskCache *cache, const DiskCacheKey *key,
+                                 const Bitmap *bm);
+
+#endif                          /* LIBASS_DISK_CACHE_H */
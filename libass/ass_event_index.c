@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass_event_index.h"
+#include "ass_utils.h"
+
+// Unsorted events are scanned linearly by every query,
+// merge them into the tree past this many
+#define EVENT_BATCH_MIN 64
+
+// Subtrees of this level or lower are scanned linearly
+#define EVENT_SCAN_LEVEL 3
+
+void ass_event_index_done(EventIndex *index)
+{
+    free(index->spans);
+    free(index->by_end);
+    free(index->max_end);
+    free(index->result);
+    memset(index, 0, sizeof(*index));
+}
+
+void ass_event_index_reset(EventIndex *index)
+{
+    index->n_spans = index->n_tree = 0;
+    index->max_level = -1;
+}
+
+static int cmp_span(const void *a, const void *b)
+{
+    const EventSpan *sa = a, *sb = b;
+    if (sa->start != sb->start)
+        return sa->start < sb->start ? -1 : 1;
+    return sa->eid - sb->eid;
+}
+
+static int cmp_span_end(const void *a, const void *b)
+{
+    const EventSpan *sa = a, *sb = b;
+    if (sa->end != sb->end)
+        return sa->end < sb->end ? -1 : 1;
+    return sa->eid - sb->eid;
+}
+
+static int cmp_eid(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+/*
+ * Implicit interval tree over spans sorted by start time.
+ * Nodes at level k are the indices with exactly k lowest bits set,
+ * the children of node x at level k are x -/+ 2^(k - 1).
+ * max_end[x] is the largest end time within the subtree of x,
+ * with missing nodes past the end of the array treated as empty.
+ */
+static void build_tree(EventIndex *index)
+{
+    const EventSpan *spans = index->spans;
+    long long *max_end = index->max_end;
+    int n = index->n_tree;
+    if (!n) {
+        index->max_level = -1;
+        return;
+    }
+
+    // the last existing node on the path from a leaf to the root,
+    // used in place of missing right children
+    int last_i = 0;
+    long long last = 0;
+    for (int i = 0; i < n; i += 2) {
+        last_i = i;
+        last = max_end[i] = spans[i].end;
+    }
+
+    int k;
+    for (k = 1; (int64_t) 1 << k <= n; k++) {
+        int x = 1 << (k - 1), step = x << 2;
+        for (int i = (x << 1) - 1; i < n; i += step) {
+            long long left = max_end[i - x];
+            long long right = i + x < n ? max_end[i + x] : last;
+            max_end[i] = FFMAX(spans[i].end, FFMAX(left, right));
+        }
+        last_i = last_i >> k & 1 ? last_i - x : last_i + x;
+        if (last_i < n && max_end[last_i] > last)
+            last = max_end[last_i];
+    }
+    index->max_level = k - 1;
+}
+
+static void merge_batch(EventIndex *index)
+{
+    EventSpan *spans = index->spans;
+    EventSpan *batch = spans + index->n_tree;
+    int n_batch = index->n_spans - index->n_tree;
+    qsort(batch, n_batch, sizeof(EventSpan), cmp_span);
+    // events usually arrive in order, so the batch can just be appended
+    if (index->n_tree && cmp_span(batch, batch - 1) < 0)
+        qsort(spans, index->n_spans, sizeof(EventSpan), cmp_span);
+    index->n_tree = index->n_spans;
+    build_tree(index);
+
+    memcpy(index->by_end, spans, index->n_tree * sizeof(EventSpan));
+    qsort(index->by_end, index->n_tree, sizeof(EventSpan), cmp_span_end);
+}
+
+bool ass_event_index_update(EventIndex *index, const ASS_Track *track)
+{
+    // events have been removed behind our back
+    if (track->n_events < index->n_spans)
+        ass_event_index_reset(index);
+
+    int n = track->n_events;
+    if (n > index->max_spans) {
+        int new_max = FFMAX(n, 2 * index->max_spans);
+        if (!ASS_REALLOC_ARRAY(index->spans, new_max) ||
+                !ASS_REALLOC_ARRAY(index->by_end, new_max) ||
+                !ASS_REALLOC_ARRAY(index->max_end, new_max) ||
+                !ASS_REALLOC_ARRAY(index->result, new_max)) {
+            ass_event_index_reset(index);
+            return false;
+        }
+        index->max_spans = new_max;
+    }
+
+    for (int i = index->n_spans; i < n; i++) {
+        const ASS_Event *event = track->events + i;
+        EventSpan *span = index->spans + i;
+        span->start = event->Start;
+        span->end = event->Start + event->Duration;
+        span->eid = i;
+    }
+    index->n_spans = n;
+
+    if (n - index->n_tree > FFMAX(EVENT_BATCH_MIN, index->n_tree >> 6))
+        merge_batch(index);
+    return true;
+}
+
+void ass_event_index_prune(EventIndex *index, long long deadline)
+{
+    // spans hold a permutation of all indexed event ids,
+    // so the result buffer can map old ids to new ones
+    int *remap = index->result;
+    for (int i = 0; i < index->n_spans; i++)
+        remap[index->spans[i].eid] = index->spans[i].end >= deadline;
+    for (int eid = 0, n = 0; eid < index->n_spans; eid++) {
+        int kept = remap[eid];
+        remap[eid] = n;
+        n += kept;
+    }
+
+    int n = 0, n_tree = 0;
+    for (int i = 0; i < index->n_spans; i++) {
+        if (i == index->n_tree)
+            n_tree = n;
+        EventSpan span = index->spans[i];
+        if (span.end < deadline)
+            continue;
+        span.eid = remap[span.eid];
+        index->spans[n++] = span;
+    }
+    if (index->n_tree == index->n_spans)
+        n_tree = n;
+
+    if (n == index->n_spans)
+        return;
+
+    // renumbering keeps the event order, so by_end stays sorted
+    int n_by_end = 0;
+    for (int i = 0; i < index->n_tree; i++) {
+        EventSpan span = index->by_end[i];
+        if (span.end < deadline)
+            continue;
+        span.eid = remap[span.eid];
+        index->by_end[n_by_end++] = span;
+    }
+
+    index->n_spans = n;
+    index->n_tree = n_tree;
+    build_tree(index);
+}
+
+static int find_in_tree(const EventIndex *index, long long now, int *result)
+{
+    const EventSpan *spans = index->spans;
+    const long long *max_end = index->max_end;
+    int n = index->n_tree, count = 0;
+    if (!n)
+        return 0;
+
+    // every level pushes at most two entries
+    struct {
+        int x, k;
+        bool visited;
+    } stack[64];
+    int top = 0;
+    stack[top].x = (1 << index->max_level) - 1;
+    stack[top].k = index->max_level;
+    stack[top++].visited = false;
+
+    while (top) {
+        top--;
+        int x = stack[top].x, k = stack[top].k;
+        if (k <= EVENT_SCAN_LEVEL) {
+            int i = x >> k << k;
+            int end = FFMIN(i + (2 << k) - 1, n);
+            for (; i < end && spans[i].start <= now; i++)
+                if (now < spans[i].end)
+                    result[count++] = spans[i].eid;
+        } else if (!stack[top].visited) {
+            // left subtree first, then revisit the node itself
+            int y = x - (1 << (k - 1));
+            stack[top++].visited = true;
+            if (y >= n || max_end[y] > now) {
+                stack[top].x = y;
+                stack[top].k = k - 1;
+                stack[top++].visited = false;
+            }
+        } else if (x < n && spans[x].start <= now) {
+            if (now < spans[x].end)
+                result[count++] = spans[x].eid;
+            stack[top].x = x + (1 << (k - 1));
+            stack[top].k = k - 1;
+            stack[top++].visited = false;
+        }
+    }
+    return count;
+}
+
+int ass_event_index_find(EventIndex *index, long long now, const int **eids)
+{
+    int *result = index->result;
+    int count = find_in_tree(index, now, result);
+    for (int i = index->n_tree; i < index->n_spans; i++) {
+        const EventSpan *span = index->spans + i;
+        if (span->start <= now && now < span->end)
+            result[count++] = span->eid;
+    }
+
+    // result is NULL for an empty track, which qsort() doesn't allow
+    if (count > 1)
+        qsort(result, count, sizeof(int), cmp_eid);
+    *eids = result;
+    return count;
+}
+
+// Number of leading tree spans starting before t, or at t unless strict
+static int count_starts(const EventIndex *index, long long t, bool strict)
+{
+    int lo = 0, hi = index->n_tree;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        long long start = index->spans[mid].start;
+        if (start < t || (!strict && start == t))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Same for the end times in by_end
+static int count_ends(const EventIndex *index, long long t, bool strict)
+{
+    int lo = 0, hi = index->n_tree;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        long long end = index->by_end[mid].end;
+        if (end < t || (!strict && end == t))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+const EventSpan *ass_event_index_last_end(const EventIndex *index, long long t)
+{
+    const EventSpan *best = NULL;
+    int i = count_ends(index, t, true);
+    if (i) {
+        // first of the equal end times, by_end is sorted by event id then
+        long long end = index->by_end[i - 1].end;
+        best = index->by_end + count_ends(index, end, true);
+    }
+
+    for (int j = index->n_tree; j < index->n_spans; j++) {
+        const EventSpan *span = index->spans + j;
+        if (span->end < t && (!best || span->end > best->end ||
+                (span->end == best->end && span->eid < best->eid)))
+            best = span;
+    }
+    return best;
+}
+
+bool ass_event_index_next_start(const EventIndex *index, long long t,
+                                long long *start)
+{
+    bool found = false;
+    int i = count_starts(index, t, false);
+    if (i < index->n_tree) {
+        *start = index->spans[i].start;
+        found = true;
+    }
+
+    for (int j = index->n_tree; j < index->n_spans; j++) {
+        long long s = index->spans[j].start;
+        if (s > t && (!found || s < *start)) {
+            *start = s;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool ass_event_index_prev_start(const EventIndex *index, long long t,
+                                long long *start)
+{
+    bool found = false;
+    int i = count_starts(index, t, true);
+    if (i) {
+        *start = index->spans[i - 1].start;
+        found = true;
+    }
+
+    for (int j = index->n_tree; j < index->n_spans; j++) {
+        long long s = index->spans[j].start;
+        if (s < t && (!found || s > *start)) {
+            *start = s;
+            found = true;
+        }
+    }
+    return found;
+}
+
+long long ass_event_index_next_change(const EventIndex *index, long long now)
+{
+    // events that are never active do not change anything,
+    // they are rare enough to be skipped one by one
+    long long next = LLONG_MAX;
+    for (int i = count_starts(index, now, false); i < index->n_tree; i++) {
+        const EventSpan *span = index->spans + i;
+        if (span->start < span->end) {
+            next = span->start;
+            break;
+        }
+    }
+    for (int i = count_ends(index, now, false); i < index->n_tree; i++) {
+        const EventSpan *span = index->by_end + i;
+        if (span->start < span->end) {
+            next = FFMIN(next, span->end);
+            break;
+        }
+    }
+
+    for (int i = index->n_tree; i < index->n_spans; i++) {
+        const EventSpan *span = index->spans + i;
+        if (span->start >= span->end)
+            continue;
+        if (span->start > now)
+            next = FFMIN(next, span->start);
+        else if (span->end > now)
+            next = FFMIN(next, span->end);
+    }
+    return next;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_EVENT_INDEX_H
+#define LIBASS_EVENT_INDEX_H
+
+#include <stdbool.h>
+
+#include "ass_types.h"
+
+// Index of event time spans for finding the events active at a given time.
+// Event times are only known once an event has been filled in, which happens
+// after ass_alloc_event(), and events can also be appended to the track
+// directly, so new events are picked up lazily by ass_event_index_update().
+// They are collected in a small unsorted batch which is merged into
+// an implicit augmented interval tree once it grows too large.
+// Boundary queries use the tree array and a copy of it sorted by end time.
+
+typedef struct {
+    long long start, end;
+    int eid;
+} EventSpan;
+
+typedef struct {
+    EventSpan *spans;       // [0, n_tree) sorted by start, then the batch
+    EventSpan *by_end;      // [0, n_tree) sorted by end
+    long long *max_end;     // maximal end time within each tree node
+    int *result;            // buffer for query results
+    int n_spans, n_tree, max_spans;
+    int max_level;          // level of the tree root
+} EventIndex;
+
+void ass_event_index_done(EventIndex *index);
+void ass_event_index_reset(EventIndex *index);
+
+// Index events appended to the track since the last update.
+// Returns false on allocation failure, the index is left empty then.
+bool ass_event_index_update(EventIndex *index, const ASS_Track *track);
+
+// Account for ass_prune_events(): drop events ending before deadline
+// and renumber the rest after the compaction of the event array.
+void ass_event_index_prune(EventIndex *index, long long deadline);
+
+// Find events with Start <= now < Start + Duration in ascending event order.
+// Returns the number of events, ids are stored in an index-owned buffer
+// valid until the next call to any function on the index.
+int ass_event_index_find(EventIndex *index, long long now, const int **eids);
+
+// Event with the latest end time before t, the first one in event order
+// among equal end times. Returns NULL if there is none.
+const EventSpan *ass_event_index_last_end(const EventIndex *index, long long t);
+
+// Earliest start time after t and latest start time before t.
+// Return false if there is none.
+bool ass_event_index_next_start(const EventIndex *index, long long t,
+                                long long *start);
+bool ass_event_index_prev_start(const EventIndex *index, long long t,
+                                long long *start);
+
+// Earliest time after now at which an event starts or stops being active,
+// LLONG_MAX if there is none.
+long long ass_event_index_next_change(const EventIndex *index, long long now);
+
+#endif                          /* LIBASS_EVENT_INDEX_H */
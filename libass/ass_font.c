@@ -476,7 +476,7 @@ fail:
  */
 ASS_Font *ass_font_new(ASS_Renderer *render_priv, ASS_FontDesc *desc)
 {
-    ASS_Font *font = ass_cache_get(render_priv->cache.font_cache, desc, render_priv);
+    ASS_Font *font = ass_cache_get_font(render_priv->cache.font_cache, desc, render_priv);
     if (!font)
         return NULL;
     if (font->library)
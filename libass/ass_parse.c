@@ -272,6 +272,23 @@ static ASS_Style *lookup_style_strict(ASS_Track *track, char *name, size_t len)
     return NULL;
 }
 
+/**
+ * \brief Check whether a tag only changes colors or transparency,
+ * which is all the renderer can animate without redrawing bitmaps.
+ * Matches tag names by prefix in the same order as ass_parse_tags().
+ */
+static bool is_color_tag(const char *p, const char *end)
+{
+    size_t len = end - p;
+    if (len >= 5 && !strncmp(p, "alpha", 5))
+        return true;
+    if (len >= 4 && !strncmp(p, "clip", 4))
+        return false;
+    if (len >= 2 && p[0] >= '1' && p[0] <= '4' && (p[1] == 'c' || p[1] == 'a'))
+        return true;
+    return len >= 1 && p[0] == 'c';
+}
+
 /**
  * \brief Parse style override tags.
  * \param p string to parse
@@ -351,6 +368,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
 #define tag(name) (mystrcmp(&p, (name)) && (push_arg(args, &nargs, p, name_end), 1))
 #define complex_tag(name) mystrcmp(&p, (name))
 
+        if (nested && !is_color_tag(p, name_end))
+            state->animated_geometry = true;
+
         // New tags introduced in vsfilter 2.39
         if (tag("xbord")) {
             double val;
@@ -514,6 +534,8 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             }
             delta_t = (uint32_t) t2 - t1;
             t = render_priv->time - state->event->Start;
+            state->animated = true;
+            state->animated_position = true;
             if (t <= t1)
                 k = 0.;
             else if (t >= t2)
@@ -648,6 +670,7 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 t3 = (uint32_t) t4 - t3;
             }
             if ((state->parsed_tags & PARSED_FADE) == 0) {
+                state->animated = true;
                 state->fade =
                     interpolate_alpha(render_priv->time -
                             state->event->Start, t1, t2,
@@ -696,6 +719,7 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 t2 = state->event->Duration;
             delta_t = (uint32_t) t2 - t1;
             t = render_priv->time - state->event->Start;        // FIXME: move to render_context
+            state->animated = true;
             if (t < t1)
                 k = 0.;
             else if (t >= t2)
@@ -966,6 +990,8 @@ void ass_apply_transition_effects(RenderContext *state)
         delay = ((int) FFMAX(delay / scale_x, 1)) * scale_x;
         state->scroll_shift =
             (render_priv->time - event->Start) / delay;
+        state->animated = true;
+        state->animated_position = true;
         state->evt_type |= EVENT_HSCROLL;
         state->detect_collisions = 0;
         state->wrap_style = 2;
@@ -996,6 +1022,8 @@ void ass_apply_transition_effects(RenderContext *state)
         delay = ((int) FFMAX(delay / scale_y, 1)) * scale_y;
         state->scroll_shift =
             (render_priv->time - event->Start) / delay;
+        state->animated = true;
+        state->animated_position = true;
         if (v[0] < v[1]) {
             y0 = v[0];
             y1 = v[1];
@@ -1058,6 +1086,8 @@ void ass_process_karaoke_effects(RenderContext *state)
             effect_type = start->effect_type;
         if (effect_type == EF_NONE)
             continue;
+        state->animated = true;
+        state->animated_geometry = true;
 
         if (start->reset_effect)
             timing = 0;
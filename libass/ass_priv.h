@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "ass_event_index.h"
 #include "ass_shaper.h"
 
 typedef enum {
@@ -68,6 +69,8 @@ struct parser_priv {
 
     long long prune_delay;
     long long prune_next_ts;
+
+    EventIndex event_index;
 };
 
 #endif /* LIBASS_PRIV_H */
@@ -29,6 +29,23 @@
 #include "ass_outline.h"
 #include "ass_rasterizer.h"
 
+// minimal outline size in pixels for large tiles with ASS_TILES_AUTO
+#define LARGE_TILES_MIN_SIZE 128
+
+// minimal number of segments for parallel filling
+#define PARALLEL_MIN_SEGMENTS 2048
+// maximal area in pixels of one parallel job
+#define JOB_MAX_AREA (128 * 128)
+
+// part of the output filled independently from the rest
+struct rasterizer_job {
+    int x, y;
+    int width, height;
+    size_t offs;  // position of the segments in RasterizerData.job_lines
+    size_t n_lines[2];
+    int winding[2];
+};
+
 
 
 static inline int ilog2(uint32_t n)
@@ -59,12 +76,41 @@ bool ass_rasterizer_init(const BitmapEngine *engine, RasterizerData *rst, int ou
     rst->size[1] = rst->capacity[1] = 0;
     rst->n_first = 0;
 
+    rst->dispatch = NULL;
+    rst->dispatch_priv = NULL;
+    rst->collect_jobs = false;
+    rst->jobs = NULL;
+    rst->n_jobs = rst->max_jobs = 0;
+    rst->job_lines = NULL;
+    rst->n_job_lines = rst->max_job_lines = 0;
+
+    rst->out_buf = NULL;
+    rst->out_stride = 0;
+    rst->tile_map = NULL;
+    rst->sparse_tiles = NULL;
+    rst->n_sparse_tiles = rst->sparse_capacity = 0;
+
     unsigned align = 1 << engine->align_order;
-    unsigned size = 1 << (2 * engine->tile_order);
+    unsigned size = 1 << (2 * engine->tile32.tile_order);
+    rst->align = align;
     rst->tile = ass_aligned_alloc(align, size, false);
     return rst->tile;
 }
 
+const TileEngine *ass_rasterizer_select_tiles(const BitmapEngine *engine,
+                                              const RasterizerData *rst,
+                                              ASS_TileSize tiles)
+{
+    if (tiles == ASS_TILES_AUTO) {
+        // padding to the larger tiles pays off only for big outlines
+        int64_t w = (int64_t) rst->bbox.x_max - rst->bbox.x_min;
+        int64_t h = (int64_t) rst->bbox.y_max - rst->bbox.y_min;
+        tiles = FFMIN(w, h) >= LARGE_TILES_MIN_SIZE << 6 ?
+            ASS_TILES_LARGE : ASS_TILES_SMALL;
+    }
+    return tiles == ASS_TILES_LARGE ? &engine->tile32 : &engine->tile16;
+}
+
 /**
  * \brief Ensure sufficient buffer size (allocate if necessary)
  * \param index index (0 or 1) of the input segment buffer (rst->linebuf)
@@ -93,6 +139,9 @@ void ass_rasterizer_done(RasterizerData *rst)
 {
     free(rst->linebuf[0]);
     free(rst->linebuf[1]);
+    free(rst->jobs);
+    free(rst->job_lines);
+    ass_aligned_free(rst->sparse_tiles);
 
     ass_aligned_free(rst->tile);
 }
@@ -537,33 +586,83 @@ static void polyline_split_vert(const struct segment *src, const size_t n_src[2]
 }
 
 
-static inline void rasterizer_fill_solid(const BitmapEngine *engine,
-                                         uint8_t *buf, int width, int height, ptrdiff_t stride,
+/**
+ * \brief Fill an output tile with a solid value
+ * \param x, y in: tile position in the output
+ */
+static inline void fill_solid_tile(const TileEngine *engine, RasterizerData *rst,
+                                   int x, int y, int set)
+{
+    if (rst->tile_map) {
+        int32_t *tile = rst->tile_map + (y >> engine->tile_order) * rst->tile_cols;
+        tile[x >> engine->tile_order] = set ? SPARSE_TILE_SOLID : SPARSE_TILE_EMPTY;
+        return;
+    }
+    engine->fill_solid(rst->out_buf + y * rst->out_stride + x, rst->out_stride, set);
+}
+
+/**
+ * \brief Get an output tile for filling with partial coverage
+ * \param x, y in: tile position in the output
+ * \param stride out: stride of the returned tile
+ * \return NULL on error
+ * Sparse output gets a new mixed tile.
+ */
+static inline uint8_t *get_mixed_tile(const TileEngine *engine, RasterizerData *rst,
+                                      int x, int y, ptrdiff_t *stride)
+{
+    if (!rst->tile_map) {
+        *stride = rst->out_stride;
+        return rst->out_buf + y * rst->out_stride + x;
+    }
+
+    size_t tile_size = (size_t) 1 << (2 * engine->tile_order);
+    // capacity is kept in bytes, as the tile size can change between fills
+    size_t size = rst->n_sparse_tiles * tile_size;
+    if (size + tile_size > rst->sparse_capacity) {
+        size_t capacity = FFMAX(2 * rst->sparse_capacity, 16 * tile_size);
+        uint8_t *tiles = ass_aligned_alloc(rst->align, capacity, false);
+        if (!tiles)
+            return NULL;
+        if (size)
+            memcpy(tiles, rst->sparse_tiles, size);
+        ass_aligned_free(rst->sparse_tiles);
+        rst->sparse_tiles = tiles;
+        rst->sparse_capacity = capacity;
+    }
+    int32_t *tile = rst->tile_map + (y >> engine->tile_order) * rst->tile_cols;
+    tile[x >> engine->tile_order] = rst->n_sparse_tiles;
+    *stride = 1 << engine->tile_order;
+    rst->n_sparse_tiles++;
+    return rst->sparse_tiles + size;
+}
+
+static inline void rasterizer_fill_solid(const TileEngine *engine, RasterizerData *rst,
+                                         int x0, int y0, int width, int height,
                                          int set)
 {
     assert(!(width  & ((1 << engine->tile_order) - 1)));
     assert(!(height & ((1 << engine->tile_order) - 1)));
 
     ptrdiff_t step = 1 << engine->tile_order;
-    ptrdiff_t tile_stride = stride * (1 << engine->tile_order);
-    width  >>= engine->tile_order;
-    height >>= engine->tile_order;
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++)
-            engine->fill_solid(buf + x * step, stride, set);
-        buf += tile_stride;
-    }
+    for (int y = 0; y < height; y += step)
+        for (int x = 0; x < width; x += step)
+            fill_solid_tile(engine, rst, x0 + x, y0 + y, set);
 }
 
-static inline void rasterizer_fill_halfplane(const BitmapEngine *engine,
-                                             uint8_t *buf, int width, int height, ptrdiff_t stride,
+static inline bool rasterizer_fill_halfplane(const TileEngine *engine, RasterizerData *rst,
+                                             int x0, int y0, int width, int height,
                                              int32_t a, int32_t b, int64_t c, int32_t scale)
 {
     assert(!(width  & ((1 << engine->tile_order) - 1)));
     assert(!(height & ((1 << engine->tile_order) - 1)));
+    ptrdiff_t stride;
+    uint8_t *buf;
     if (width == 1 << engine->tile_order && height == 1 << engine->tile_order) {
+        if (!(buf = get_mixed_tile(engine, rst, x0, y0, &stride)))
+            return false;
         engine->fill_halfplane(buf, stride, a, b, c, scale);
-        return;
+        return true;
     }
 
     uint32_t abs_a = a < 0 ? -a : a;
@@ -572,7 +671,6 @@ static inline void rasterizer_fill_halfplane(const BitmapEngine *engine,
     int64_t offs = ((int64_t) a + b) * (1 << (engine->tile_order + 5));
 
     ptrdiff_t step = 1 << engine->tile_order;
-    ptrdiff_t tile_stride = stride * (1 << engine->tile_order);
     width  >>= engine->tile_order;
     height >>= engine->tile_order;
     for (int y = 0; y < height; y++) {
@@ -580,14 +678,17 @@ static inline void rasterizer_fill_halfplane(const BitmapEngine *engine,
             int64_t cc = c - (a * (int64_t) x + b * (int64_t) y) * (1 << (engine->tile_order + 6));
             int64_t offs_c = offs - cc;
             int64_t abs_c = offs_c < 0 ? -offs_c : offs_c;
-            if (abs_c < size)
-                engine->fill_halfplane(buf + x * step, stride, a, b, cc, scale);
-            else
-                engine->fill_solid(buf + x * step, stride,
-                                   ((uint32_t) (offs_c >> 32) ^ scale) & 0x80000000);
+            if (abs_c < size) {
+                if (!(buf = get_mixed_tile(engine, rst, x0 + x * step, y0 + y * step, &stride)))
+                    return false;
+                engine->fill_halfplane(buf, stride, a, b, cc, scale);
+            } else {
+                fill_solid_tile(engine, rst, x0 + x * step, y0 + y * step,
+                                ((uint32_t) (offs_c >> 32) ^ scale) & 0x80000000);
+            }
         }
-        buf += tile_stride;
     }
+    return true;
 }
 
 enum {
@@ -618,17 +719,57 @@ static inline int get_fill_flags(struct segment *line, size_t n_lines, int windi
     }
 }
 
+/**
+ * \brief Postpone filling of a quad-tree level, see ass_rasterizer_fill()
+ * \param line, n_lines, winding in: same as for rasterizer_fill_level()
+ * \return false on error
+ * Copies the segments out of the input buffer.
+ */
+static bool add_job(RasterizerData *rst, int x, int y, int width, int height,
+                    const struct segment *line, const size_t n_lines[2], const int winding[2])
+{
+    size_t n = n_lines[0] + n_lines[1];
+    if (rst->n_jobs >= rst->max_jobs) {
+        size_t max_jobs = FFMAX(2 * rst->max_jobs, 16);
+        if (!ASS_REALLOC_ARRAY(rst->jobs, max_jobs))
+            return false;
+        rst->max_jobs = max_jobs;
+    }
+    if (rst->n_job_lines + n > rst->max_job_lines) {
+        size_t max_lines = FFMAX(2 * rst->max_job_lines, 256);
+        while (max_lines < rst->n_job_lines + n)
+            max_lines *= 2;
+        if (!ASS_REALLOC_ARRAY(rst->job_lines, max_lines))
+            return false;
+        rst->max_job_lines = max_lines;
+    }
+
+    struct rasterizer_job *job = rst->jobs + rst->n_jobs++;
+    job->x = x;
+    job->y = y;
+    job->width = width;
+    job->height = height;
+    job->offs = rst->n_job_lines;
+    job->n_lines[0] = n_lines[0];
+    job->n_lines[1] = n_lines[1];
+    job->winding[0] = winding[0];
+    job->winding[1] = winding[1];
+    memcpy(rst->job_lines + rst->n_job_lines, line, n * sizeof(struct segment));
+    rst->n_job_lines += n;
+    return true;
+}
+
 /**
  * \brief Main quad-tree filling function
+ * \param x, y, width, height output rectangle of the level
  * \param index index (0 or 1) of the input segment buffer (rst->linebuf)
- * \param offs current offset from the beginning of the buffer
  * \param winding bottom-left winding value
  * \return false on error
  * Rasterizes (possibly recursive) one quad-tree level.
  * Truncates used input buffer.
  */
-static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rst,
-                                  uint8_t *buf, int width, int height, ptrdiff_t stride,
+static bool rasterizer_fill_level(const TileEngine *engine, RasterizerData *rst,
+                                  int x, int y, int width, int height,
                                   int index, const size_t n_lines[2], const int winding[2])
 {
     assert(width > 0 && height > 0);
@@ -642,20 +783,23 @@ static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rs
     int flags1 = get_fill_flags(line1, n_lines[1], winding[1]);
     int flags = (flags0 | flags1) ^ FLAG_COMPLEX;
     if (flags & (FLAG_SOLID | FLAG_COMPLEX)) {
-        rasterizer_fill_solid(engine, buf, width, height, stride, flags & FLAG_SOLID);
+        rasterizer_fill_solid(engine, rst, x, y, width, height, flags & FLAG_SOLID);
         rst->size[index] = offs;
         return true;
     }
     if (!(flags & FLAG_GENERIC) && ((flags0 ^ flags1) & FLAG_COMPLEX)) {
         if (flags1 & FLAG_COMPLEX)
             line = line1;
-        rasterizer_fill_halfplane(engine, buf, width, height, stride,
-                                  line->a, line->b, line->c,
-                                  flags & FLAG_REVERSE ? -line->scale : line->scale);
         rst->size[index] = offs;
-        return true;
+        return rasterizer_fill_halfplane(engine, rst, x, y, width, height,
+                                         line->a, line->b, line->c,
+                                         flags & FLAG_REVERSE ? -line->scale : line->scale);
     }
     if (width == 1 << engine->tile_order && height == 1 << engine->tile_order) {
+        ptrdiff_t stride;
+        uint8_t *buf = get_mixed_tile(engine, rst, x, y, &stride);
+        if (!buf)
+            return false;
         if (!(flags1 & FLAG_COMPLEX)) {
             engine->fill_generic(buf, stride, line, n_lines[0], winding[0]);
             rst->size[index] = offs;
@@ -681,13 +825,18 @@ static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rs
         return true;
     }
 
+    if (rst->collect_jobs && (int64_t) width * height <= JOB_MAX_AREA) {
+        rst->size[index] = offs;
+        return add_job(rst, x, y, width, height, line, n_lines, winding);
+    }
+
     size_t offs1 = rst->size[index ^ 1];
     if (!check_capacity(rst, index ^ 1, n_lines[0] + n_lines[1]))
         return false;
     struct segment *dst0 = line;
     struct segment *dst1 = rst->linebuf[index ^ 1] + offs1;
 
-    uint8_t *buf1 = buf;
+    int x1 = x, y1 = y;
     int width1  = width;
     int height1 = height;
     size_t n_next0[2], n_next1[2];
@@ -695,14 +844,14 @@ static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rs
     if (width > height) {
         width = 1 << ilog2(width - 1);
         width1 -= width;
-        buf1 += width;
+        x1 += width;
         polyline_split_horz(line, n_lines,
                             dst0, n_next0, dst1, n_next1,
                             winding1, (int32_t) width << 6);
     } else {
         height = 1 << ilog2(height - 1);
         height1 -= height;
-        buf1 += height * stride;
+        y1 += height;
         polyline_split_vert(line, n_lines,
                             dst0, n_next0, dst1, n_next1,
                             winding1, (int32_t) height << 6);
@@ -710,18 +859,21 @@ static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rs
     rst->size[index ^ 0] = offs  + n_next0[0] + n_next0[1];
     rst->size[index ^ 1] = offs1 + n_next1[0] + n_next1[1];
 
-    if (!rasterizer_fill_level(engine, rst, buf,  width,  height,  stride, index ^ 0, n_next0,  winding))
+    if (!rasterizer_fill_level(engine, rst, x,  y,  width,  height,  index ^ 0, n_next0, winding))
         return false;
     assert(rst->size[index ^ 0] == offs);
-    if (!rasterizer_fill_level(engine, rst, buf1, width1, height1, stride, index ^ 1, n_next1, winding1))
+    if (!rasterizer_fill_level(engine, rst, x1, y1, width1, height1, index ^ 1, n_next1, winding1))
         return false;
     assert(rst->size[index ^ 1] == offs1);
     return true;
 }
 
-bool ass_rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
-                         uint8_t *buf, int x0, int y0,
-                         int width, int height, ptrdiff_t stride)
+/**
+ * \brief Common part of dense and sparse filling
+ * The output must be set up in rst.
+ */
+static bool rasterizer_fill(const TileEngine *engine, RasterizerData *rst,
+                            int x0, int y0, int width, int height)
 {
     assert(width > 0 && height > 0);
     assert(!(width  & ((1 << engine->tile_order) - 1)));
@@ -779,7 +931,68 @@ bool ass_rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
     }
     rst->size[0] = n_lines[0] + n_lines[1];
     rst->size[1] = 0;
-    return rasterizer_fill_level(engine, rst,
-                                 buf, width, height, stride,
-                                 0, n_lines, winding);
+    // sparse output allocates tiles as it goes, so it is always serial
+    if (!rst->dispatch || rst->tile_map || rst->size[0] < PARALLEL_MIN_SEGMENTS ||
+            (int64_t) width * height <= 2 * JOB_MAX_AREA)
+        return rasterizer_fill_level(engine, rst,
+                                     0, 0, width, height,
+                                     0, n_lines, winding);
+
+    // Split into the same quad-tree as the serial path, but stop at
+    // small enough levels and fill those later, possibly in parallel.
+    // The levels are disjoint and filled by the same code, so the output
+    // does not depend on the number of threads.
+    rst->collect_jobs = true;
+    rst->job_engine = engine;
+    rst->n_jobs = rst->n_job_lines = 0;
+    bool res = rasterizer_fill_level(engine, rst,
+                                     0, 0, width, height,
+                                     0, n_lines, winding);
+    rst->collect_jobs = false;
+    if (!res)
+        return false;
+    if (!rst->n_jobs)
+        return true;
+    return rst->dispatch(rst->dispatch_priv, rst, rst->n_jobs);
+}
+
+bool ass_rasterizer_fill(const TileEngine *engine, RasterizerData *rst,
+                         uint8_t *buf, int x0, int y0,
+                         int width, int height, ptrdiff_t stride)
+{
+    rst->out_buf = buf;
+    rst->out_stride = stride;
+    rst->tile_map = NULL;
+    return rasterizer_fill(engine, rst, x0, y0, width, height);
+}
+
+bool ass_rasterizer_fill_sparse(const TileEngine *engine, RasterizerData *rst,
+                                int32_t *tile_map, int x0, int y0,
+                                int width, int height)
+{
+    rst->out_buf = NULL;
+    rst->out_stride = 0;
+    rst->tile_map = tile_map;
+    rst->tile_cols = width >> engine->tile_order;
+    rst->n_sparse_tiles = 0;
+    bool res = rasterizer_fill(engine, rst, x0, y0, width, height);
+    rst->tile_map = NULL;
+    return res;
+}
+
+bool ass_rasterizer_fill_job(RasterizerData *rst, const RasterizerData *src, size_t index)
+{
+    const struct rasterizer_job *job = src->jobs + index;
+    size_t n = job->n_lines[0] + job->n_lines[1];
+    rst->size[0] = rst->size[1] = 0;
+    if (!check_capacity(rst, 0, n))
+        return false;
+    memcpy(rst->linebuf[0], src->job_lines + job->offs, n * sizeof(struct segment));
+    rst->size[0] = n;
+    rst->out_buf = src->out_buf;
+    rst->out_stride = src->out_stride;
+    rst->tile_map = NULL;
+    return rasterizer_fill_level(src->job_engine, rst,
+                                 job->x, job->y, job->width, job->height,
+                                 0, job->n_lines, job->winding);
 }
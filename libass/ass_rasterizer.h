@@ -42,7 +42,21 @@ struct segment {
     int32_t x_min, x_max, y_min, y_max;
 };
 
-typedef struct {
+struct rasterizer_job;
+typedef struct rasterizer_data RasterizerData;
+
+/**
+ * \brief Run the jobs of a large outline, possibly in parallel
+ * \param priv in: opaque dispatcher data
+ * \param rst in: rasterizer holding the jobs
+ * \param n_jobs in: number of jobs
+ * \return false if any job failed
+ * Every job must be executed once with ass_rasterizer_fill_job(),
+ * each thread using its own RasterizerData.
+ */
+typedef bool RasterizerDispatchFunc(void *priv, const RasterizerData *rst, size_t n_jobs);
+
+struct rasterizer_data {
     int outline_error;  // acceptable error (in 1/64 pixel units)
 
     // usable after rasterizer_set_outline
@@ -54,7 +68,28 @@ typedef struct {
     size_t n_first;
 
     uint8_t *tile;
-} RasterizerData;
+    unsigned align;
+
+    // output of the current fill, dense or sparse
+    uint8_t *out_buf;
+    ptrdiff_t out_stride;
+    int32_t *tile_map;
+    int32_t tile_cols;
+    uint8_t *sparse_tiles;  // mixed tiles of sparse output
+    size_t n_sparse_tiles, sparse_capacity;  // capacity in bytes
+
+    // optional parallel filling of large outlines
+    RasterizerDispatchFunc *dispatch;
+    void *dispatch_priv;
+
+    // independent parts of the current outline, see ass_rasterizer_fill()
+    bool collect_jobs;
+    const TileEngine *job_engine;
+    struct rasterizer_job *jobs;
+    size_t n_jobs, max_jobs;
+    struct segment *job_lines;
+    size_t n_job_lines, max_job_lines;
+};
 
 bool ass_rasterizer_init(const BitmapEngine *engine, RasterizerData *rst, int outline_error);
 void ass_rasterizer_done(RasterizerData *rst);
@@ -68,6 +103,16 @@ void ass_rasterizer_done(RasterizerData *rst);
 bool ass_rasterizer_set_outline(RasterizerData *rst,
                                 const ASS_Outline *path, bool extra);
 
+/**
+ * \brief Choose tile functions for the current outline
+ * \param tiles in: requested tile size, ASS_TILES_AUTO decides by bbox size
+ * \return tile functions for ass_rasterizer_fill(),
+ * output dimensions must be multiples of their tile size
+ */
+const TileEngine *ass_rasterizer_select_tiles(const BitmapEngine *engine,
+                                              const RasterizerData *rst,
+                                              ASS_TileSize tiles);
+
 /**
  * \brief Polyline rasterization function
  * \param x0, y0, width, height in: source window (full pixel units)
@@ -75,10 +120,33 @@ bool ass_rasterizer_set_outline(RasterizerData *rst,
  * \param stride output buffer stride (aligned)
  * \return false on error
  * Deletes preprocessed polyline after work.
+ * Outlines with many segments are split into jobs given to rst->dispatch if set.
  */
-bool ass_rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
+bool ass_rasterizer_fill(const TileEngine *engine, RasterizerData *rst,
                          uint8_t *buf, int x0, int y0,
                          int width, int height, ptrdiff_t stride);
 
+/**
+ * \brief Polyline rasterization into a sparse tiled bitmap
+ * \param x0, y0, width, height in: source window (full pixel units)
+ * \param tile_map out: tile states in row order, one of SPARSE_TILE_EMPTY,
+ * SPARSE_TILE_SOLID or the index of a mixed tile in rst->sparse_tiles
+ * \return false on error
+ * Mixed tiles are stored one after another with the tile size as stride
+ * and stay valid until the next call. Deletes preprocessed polyline after work.
+ */
+bool ass_rasterizer_fill_sparse(const TileEngine *engine, RasterizerData *rst,
+                                int32_t *tile_map, int x0, int y0,
+                                int width, int height);
+
+/**
+ * \brief Fill the part of the output described by one job
+ * \param rst in: rasterizer of the calling thread, can be the same as src
+ * \param src in: rasterizer holding the jobs
+ * \param index in: job index
+ * \return false on error
+ */
+bool ass_rasterizer_fill_job(RasterizerData *rst, const RasterizerData *src, size_t index);
+
 
 #endif /* LIBASS_RASTERIZER_H */
@@ -97,8 +97,13 @@ static void render_context_done(RenderContext *state)
         ass_shaper_free(state->shaper);
 
     text_info_done(&state->text_info);
+    free(state->layout_keys);
+    free(state->run_starts);
+    free(state->cmap);
 }
 
+static void stop_threads(ASS_Renderer *priv);
+
 ASS_Renderer *ass_renderer_init(ASS_Library *library)
 {
     int error;
@@ -125,15 +130,25 @@ ASS_Renderer *ass_renderer_init(ASS_Library *library)
         goto fail;
     }
 
+    if (!ass_mutex_init(&priv->font_lock)) {
+        FT_Done_FreeType(ft);
+        free(priv);
+        priv = NULL;
+        goto fail;
+    }
+    if (!ass_mutex_init(&priv->layout_lock)) {
+        ass_mutex_destroy(&priv->font_lock);
+        FT_Done_FreeType(ft);
+        free(priv);
+        priv = NULL;
+        goto fail;
+    }
+
     priv->library = library;
     priv->ftlibrary = ft;
     // images_root and related stuff is zero-filled in calloc
 
-    unsigned flags = ASS_CPU_FLAG_ALL;
-#if CONFIG_LARGE_TILES
-    flags |= ASS_FLAG_LARGE_TILES;
-#endif
-    priv->engine = ass_bitmap_engine_init(flags);
+    priv->engine = ass_bitmap_engine_init(ASS_CPU_FLAG_ALL);
 
     priv->cache.font_cache = ass_font_cache_create();
     priv->cache.bitmap_cache = ass_bitmap_cache_create();
@@ -148,6 +163,7 @@ ASS_Renderer *ass_renderer_init(ASS_Library *library)
 
     priv->cache.glyph_max = GLYPH_CACHE_MAX;
     priv->cache.bitmap_max_size = BITMAP_CACHE_MAX_SIZE;
+    priv->cache.lookahead = -1;
     priv->cache.composite_max_size = COMPOSITE_CACHE_MAX_SIZE;
 
     if (!render_context_init(&priv->state, priv))
@@ -160,6 +176,7 @@ ASS_Renderer *ass_renderer_init(ASS_Library *library)
 
     ass_shaper_info(library);
     priv->settings.shaper = ASS_SHAPING_COMPLEX;
+    priv->settings.tile_size = CONFIG_LARGE_TILES ? ASS_TILES_LARGE : ASS_TILES_SMALL;
 
     ass_msg(library, MSGL_V, "Initialized");
 
@@ -177,8 +194,17 @@ void ass_renderer_done(ASS_Renderer *render_priv)
     if (!render_priv)
         return;
 
+    stop_threads(render_priv);
+
     ass_frame_unref(render_priv->images_root);
     ass_frame_unref(render_priv->prev_images_root);
+    free(render_priv->image_refs);
+    free(render_priv->chroma_mask);
+    ass_atlas_done(&render_priv->atlas);
+    ass_flush_static_events(render_priv);
+    free(render_priv->static_events);
+    ass_flush_layouts(render_priv);
+    free(render_priv->layouts);
 
     ass_cache_done(render_priv->cache.composite_cache);
     ass_cache_done(render_priv->cache.bitmap_cache);
@@ -187,6 +213,11 @@ void ass_renderer_done(ASS_Renderer *render_priv)
     ass_cache_done(render_priv->cache.metrics_cache);
     ass_cache_done(render_priv->cache.font_cache);
 
+    if (render_priv->cache.disk_cache) {
+        ass_disk_cache_save(render_priv->cache.disk_cache);
+        ass_disk_cache_close(render_priv->cache.disk_cache);
+    }
+
     if (render_priv->fontselect)
         ass_fontselect_free(render_priv->fontselect);
     if (render_priv->ftlibrary)
@@ -200,6 +231,8 @@ void ass_renderer_done(ASS_Renderer *render_priv)
 
     free(render_priv->user_override_style.FontName);
 
+    ass_mutex_destroy(&render_priv->layout_lock);
+    ass_mutex_destroy(&render_priv->font_lock);
     free(render_priv);
 }
 
@@ -230,7 +263,9 @@ static ASS_Image *my_draw_bitmap(unsigned char *bitmap, int bitmap_w,
     img->source = source;
     ass_cache_inc_ref(source);
     img->buffer = source ? NULL : bitmap;
+    img->buffer_refs = NULL;
     img->ref_count = 0;
+    img->run = -1;
 
     return &img->result;
 }
@@ -686,9 +721,21 @@ static void restore_transform(double m[3][3], const BitmapHashKey *key)
         m[i][2] -= m[i][0] * x0 + m[i][1] * y0;
 }
 
+// Associate a cache item with the time span of the current event
+// for timeline-aware eviction
+static inline void tag_cache_item(RenderContext *state, void *value)
+{
+    ASS_Event *event = state->event;
+    if (value && state->renderer->cache.lookahead >= 0)
+        ass_cache_tag(value, event->Start, event->Start + event->Duration);
+}
+
 // Calculate bitmap memory footprint
 static inline size_t bitmap_size(const Bitmap *bm)
 {
+    if (bm->tile_map)
+        return ((size_t) bm->n_mixed << (2 * bm->tile_order)) +
+            sizeof(int32_t) * (bm->w >> bm->tile_order) * (bm->h >> bm->tile_order);
     return bm->stride * bm->h;
 }
 
@@ -720,14 +767,16 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
 
     ASS_Vector pos;
     BitmapHashKey key;
-    key.outline = ass_cache_get(render_priv->cache.outline_cache, &ol_key, render_priv);
+    key.outline = ass_cache_get_outline(render_priv->cache.outline_cache, &ol_key, render_priv);
+    key.sparse = true;
     if (!key.outline || !key.outline->valid ||
             !quantize_transform(m, &pos, NULL, true, &key))
         return;
 
-    Bitmap *clip_bm = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    Bitmap *clip_bm = ass_cache_get_bitmap(render_priv->cache.bitmap_cache, &key, state);
     if (!clip_bm)
         return;
+    tag_cache_item(state, clip_bm);
 
     // Iterate through bitmaps and blend/clip them
     for (ASS_Image *cur = head; cur; cur = cur->next) {
@@ -763,23 +812,43 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
         btop = top - by;
 
         unsigned align = 1 << render_priv->engine.align_order;
+        uint8_t *clip_tmp = NULL;
         if (state->clip_drawing_mode) {
             // Inverse clip
             if (ax + aw < bx || ay + ah < by || ax > bx + bw ||
                 ay > by + bh || !h || !w) {
                 continue;
             }
+            int value = ass_bitmap_uniform_value(clip_bm, bleft, btop, w, h);
+            if (!value)
+                continue;
+            if (value < 0 && clip_bm->tile_map) {
+                bs = ass_align(align, w);
+                clip_tmp = ass_aligned_alloc(align, bs * h + align, false);
+                if (!clip_tmp)
+                    break;
+                ass_bitmap_extract(clip_bm, clip_tmp, bs, bleft, btop, w, h);
+                bbuffer = clip_tmp;
+                bleft = btop = 0;
+            }
 
             // Allocate new buffer and add to free list
             nbuffer = ass_aligned_alloc(align, as * ah + align, false);
-            if (!nbuffer)
+            if (!nbuffer) {
+                ass_aligned_free(clip_tmp);
                 break;
+            }
 
             // Blend together
             memcpy(nbuffer, abuffer, ((ah - 1) * as) + aw);
-            render_priv->engine.imul_bitmaps(nbuffer + atop * as + aleft, as,
-                                             bbuffer + btop * bs + bleft, bs,
-                                             w, h);
+            if (value == 255) {
+                for (int y = 0; y < h; y++)
+                    memset(nbuffer + (atop + y) * as + aleft, 0, w);
+            } else {
+                render_priv->engine.imul_bitmaps(nbuffer + atop * as + aleft, as,
+                                                 bbuffer + btop * bs + bleft, bs,
+                                                 w, h);
+            }
         } else {
             // Regular clip
             if (ax + aw < bx || ay + ah < by || ax > bx + bw ||
@@ -787,12 +856,37 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
                 cur->w = cur->h = cur->stride = 0;
                 continue;
             }
+            int value = ass_bitmap_uniform_value(clip_bm, bleft, btop, w, h);
+            if (!value) {
+                cur->w = cur->h = cur->stride = 0;
+                continue;
+            }
+            if (value == 255) {
+                // Only crop, the image keeps its buffer
+                cur->bitmap += atop * as + aleft;
+                cur->dst_x += aleft;
+                cur->dst_y += atop;
+                cur->w = w;
+                cur->h = h;
+                continue;
+            }
+            if (clip_bm->tile_map) {
+                bs = ass_align(align, w);
+                clip_tmp = ass_aligned_alloc(align, bs * h + align, false);
+                if (!clip_tmp)
+                    break;
+                ass_bitmap_extract(clip_bm, clip_tmp, bs, bleft, btop, w, h);
+                bbuffer = clip_tmp;
+                bleft = btop = 0;
+            }
 
             // Allocate new buffer and add to free list
             unsigned ns = ass_align(align, w);
             nbuffer = ass_aligned_alloc(align, ns * h + align, false);
-            if (!nbuffer)
+            if (!nbuffer) {
+                ass_aligned_free(clip_tmp);
                 break;
+            }
 
             // Blend together
             render_priv->engine.mul_bitmaps(nbuffer, ns,
@@ -805,6 +899,7 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
             cur->h = h;
             cur->stride = ns;
         }
+        ass_aligned_free(clip_tmp);
 
         ASS_ImagePriv *priv = (ASS_ImagePriv *) cur;
         priv->buffer = cur->bitmap = nbuffer;
@@ -813,6 +908,13 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
     }
 }
 
+// Remember the combined bitmap the images from first to last were rendered from
+static void set_image_run(ASS_Image **first, ASS_Image **last, int run)
+{
+    for (; first != last; first = &(*first)->next)
+        ((ASS_ImagePriv *) *first)->run = run;
+}
+
 /**
  * \brief Convert TextInfo struct to ASS_Image list
  * Splits glyphs in halves when needed (for \kf karaoke).
@@ -829,9 +931,11 @@ static ASS_Image *render_text(RenderContext *state)
         if (!info->bm_s || state->border_style == 4)
             continue;
 
+        ASS_Image **first = tail;
         tail =
             render_glyph(state, info->bm_s, info->x, info->y, info->c[3], 0,
                          1000000, tail, IMAGE_TYPE_SHADOW, info->image);
+        set_image_run(first, tail, i);
     }
 
     for (unsigned i = 0; i < n_bitmaps; i++) {
@@ -839,6 +943,7 @@ static ASS_Image *render_text(RenderContext *state)
         if (!info->bm_o)
             continue;
 
+        ASS_Image **first = tail;
         if ((info->effect_type == EF_KARAOKE_KO)
                 && (info->effect_timing <= 0)) {
             // do nothing
@@ -847,6 +952,7 @@ static ASS_Image *render_text(RenderContext *state)
                 render_glyph(state, info->bm_o, info->x, info->y, info->c[2],
                              0, 1000000, tail, IMAGE_TYPE_OUTLINE, info->image);
         }
+        set_image_run(first, tail, i);
     }
 
     for (unsigned i = 0; i < n_bitmaps; i++) {
@@ -854,6 +960,7 @@ static ASS_Image *render_text(RenderContext *state)
         if (!info->bm)
             continue;
 
+        ASS_Image **first = tail;
         if ((info->effect_type == EF_KARAOKE)
                 || (info->effect_type == EF_KARAOKE_KO)) {
             if (info->effect_timing > 0)
@@ -875,6 +982,7 @@ static ASS_Image *render_text(RenderContext *state)
             tail =
                 render_glyph(state, info->bm, info->x, info->y, info->c[0],
                              0, 1000000, tail, IMAGE_TYPE_CHARACTER, info->image);
+        set_image_run(first, tail, i);
     }
 
     *tail = 0;
@@ -1138,6 +1246,9 @@ init_render_context(RenderContext *state, ASS_Event *event)
     state->fade = 0;
     state->drawing_scale = 0;
     state->pbo = 0;
+    state->animated = false;
+    state->animated_geometry = false;
+    state->animated_position = false;
     state->effect_type = EF_NONE;
     state->effect_timing = 0;
     state->effect_skip_timing = 0;
@@ -1181,7 +1292,7 @@ get_outline_glyph(RenderContext *state, GlyphInfo *info)
     if (info->drawing_text.str) {
         key.type = OUTLINE_DRAWING;
         key.u.drawing.text = info->drawing_text;
-        val = ass_cache_get(priv->cache.outline_cache, &key, priv);
+        val = ass_cache_get_outline(priv->cache.outline_cache, &key, priv);
         if (!val || !val->valid)
             return;
 
@@ -1204,7 +1315,7 @@ get_outline_glyph(RenderContext *state, GlyphInfo *info)
         k->italic = info->italic;
         k->flags = info->flags;
 
-        val = ass_cache_get(priv->cache.outline_cache, &key, priv);
+        val = ass_cache_get_outline(priv->cache.outline_cache, &key, priv);
         if (!val || !val->valid)
             return;
 
@@ -1238,6 +1349,16 @@ size_t ass_outline_construct(void *key, void *value, void *priv)
     OutlineHashValue *v = value;
     memset(v, 0, sizeof(*v));
 
+    DiskCache *disk_cache = render_priv->cache.disk_cache;
+    if (disk_cache && ass_disk_cache_outline_key(&v->disk_key, outline_key,
+                                                 render_priv->settings.hinting)) {
+        v->has_disk_key = true;
+        if (ass_disk_cache_load_outline(disk_cache, &v->disk_key, v))
+            return 1;
+    } else {
+        disk_cache = NULL;
+    }
+
     switch (outline_key->type) {
     case OUTLINE_GLYPH:
         {
@@ -1317,6 +1438,8 @@ size_t ass_outline_construct(void *key, void *value, void *priv)
     if (v->cbox.x_min > v->cbox.x_max || v->cbox.y_min > v->cbox.y_max)
         v->cbox.x_min = v->cbox.y_min = v->cbox.x_max = v->cbox.y_max = 0;
     v->valid = true;
+    if (disk_cache)
+        ass_disk_cache_store_outline(disk_cache, &v->disk_key, v);
     return 1;
 }
 
@@ -1406,10 +1529,12 @@ get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
 
     BitmapHashKey key;
     key.outline = info->outline;
+    key.sparse = false;
     if (!quantize_transform(m, pos, offset, first, &key))
         return;
 
-    info->bm = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    info->bm = ass_cache_get_bitmap(render_priv->cache.bitmap_cache, &key, state);
+    tag_cache_item(state, info->bm);
     if (!info->bm || !info->bm->buffer)
         info->bm = NULL;
 
@@ -1528,12 +1653,14 @@ get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
         }
     }
 
-    key.outline = ass_cache_get(render_priv->cache.outline_cache, &ol_key, render_priv);
+    key.outline = ass_cache_get_outline(render_priv->cache.outline_cache, &ol_key, render_priv);
+    key.sparse = false;
     if (!key.outline || !key.outline->valid ||
             !quantize_transform(m, pos_o, offset, false, &key))
         return;
 
-    info->bm_o = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    info->bm_o = ass_cache_get_bitmap(render_priv->cache.bitmap_cache, &key, state);
+    tag_cache_item(state, info->bm_o);
     if (!info->bm_o || !info->bm_o->buffer) {
         info->bm_o = NULL;
         *pos_o = *pos;
@@ -1552,6 +1679,17 @@ size_t ass_bitmap_construct(void *key, void *value, void *priv)
     BitmapHashKey *k = key;
     Bitmap *bm = value;
 
+    ASS_Renderer *render_priv = state->renderer;
+    DiskCache *disk_cache = render_priv->cache.disk_cache;
+    DiskCacheKey disk_key;
+    // the disk cache only holds dense bitmaps
+    if (k->sparse || (disk_cache &&
+            !ass_disk_cache_bitmap_key(&disk_key, k, render_priv->settings.tile_size)))
+        disk_cache = NULL;
+    if (disk_cache && ass_disk_cache_load_bitmap(disk_cache, &disk_key,
+                                                 &render_priv->engine, bm))
+        goto done;
+
     double m[3][3];
     restore_transform(m, k);
 
@@ -1564,11 +1702,14 @@ size_t ass_bitmap_construct(void *key, void *value, void *priv)
         ass_outline_transform_2d(&outline[1], &k->outline->outline[1], m);
     }
 
-    if (!ass_outline_to_bitmap(state, bm, &outline[0], &outline[1]))
+    if (!ass_outline_to_bitmap(state, bm, &outline[0], &outline[1], k->sparse))
         memset(bm, 0, sizeof(*bm));
     ass_outline_free(&outline[0]);
     ass_outline_free(&outline[1]);
+    if (disk_cache)
+        ass_disk_cache_store_bitmap(disk_cache, &disk_key, bm);
 
+done:
     return sizeof(BitmapHashKey) + sizeof(Bitmap) + bitmap_size(bm) +
            sizeof(OutlineHashValue) + outline_size(&k->outline->outline[0]) + outline_size(&k->outline->outline[1]);
 }
@@ -2294,11 +2435,11 @@ static void reorder_text(RenderContext *state)
     }
 }
 
-static void apply_baseline_shear(RenderContext *state)
+static void apply_baseline_shear(RenderContext *state,
+                                 const FriBidiStrIndex *cmap)
 {
     ASS_Renderer *render_priv = state->renderer;
     TextInfo *text_info = &state->text_info;
-    FriBidiStrIndex *cmap = ass_shaper_get_reorder_map(state->shaper);
     int32_t shear = 0;
     bool whole_text_layout =
         render_priv->track->parser_priv->feature_flags &
@@ -2470,6 +2611,33 @@ static double restore_blur(int qblur)
 }
 
 // Convert glyphs to bitmaps, combine them, apply blur, generate shadows.
+static int get_filter_flags(const GlyphInfo *info)
+{
+    int flags = 0;
+    if (info->border_style == 3)
+        flags |= FILTER_BORDER_STYLE_3;
+    if (info->border_x || info->border_y)
+        flags |= FILTER_NONZERO_BORDER;
+    if (info->shadow_x || info->shadow_y)
+        flags |= FILTER_NONZERO_SHADOW;
+    if (flags & FILTER_NONZERO_SHADOW &&
+        (info->effect_type == EF_KARAOKE_KF ||
+         info->effect_type == EF_KARAOKE_KO ||
+         _a(info->c[0]) != 0xFF ||
+         info->border_style == 3))
+        flags |= FILTER_FILL_IN_SHADOW;
+    if (!(flags & FILTER_NONZERO_BORDER) &&
+        !(flags & FILTER_FILL_IN_SHADOW))
+        flags &= ~FILTER_NONZERO_SHADOW;
+    if ((flags & FILTER_NONZERO_BORDER &&
+         _a(info->c[0]) == 0 &&
+         _a(info->c[1]) == 0 &&
+         info->fade == 0) ||
+        info->border_style == 3)
+        flags |= FILTER_FILL_IN_BORDER;
+    return flags;
+}
+
 static void render_and_combine_glyphs(RenderContext *state,
                                       double device_x, double device_y)
 {
@@ -2477,6 +2645,32 @@ static void render_and_combine_glyphs(RenderContext *state,
     TextInfo *text_info = &state->text_info;
     int left = render_priv->settings.left_margin;
     device_x = (device_x - left) * render_priv->par_scale_x + left;
+
+    // If enabled, events that only move are rendered at whole pixel positions,
+    // so that their glyphs and composites are the same in every frame,
+    // and the composites are shifted by the remaining fraction instead.
+    // That is an approximation, see ass_set_approximate_moves().
+    // The rotation origin moves along unless set explicitly.
+    ASS_Vector subpixel = {0, 0};
+    if (render_priv->settings.approximate_moves &&
+            state->animated_position && !state->animated_geometry &&
+            !state->have_origin) {
+        double x = floor(device_x), y = floor(device_y);
+        subpixel.x = ass_lrint((device_x - x) * (1 << SUBPIXEL_ORDER));
+        subpixel.y = ass_lrint((device_y - y) * (1 << SUBPIXEL_ORDER));
+        subpixel.x <<= 6 - SUBPIXEL_ORDER;
+        subpixel.y <<= 6 - SUBPIXEL_ORDER;
+        if (subpixel.x == 64) {
+            x++;
+            subpixel.x = 0;
+        }
+        if (subpixel.y == 64) {
+            y++;
+            subpixel.y = 0;
+        }
+        device_x = x;
+        device_y = y;
+    }
     unsigned nb_bitmaps = 0;
     bool new_run = true;
     CombinedBitmapInfo *combined_info = text_info->combined_bitmaps;
@@ -2489,28 +2683,7 @@ static void render_and_combine_glyphs(RenderContext *state,
             continue;
 
         for (; info; info = info->next) {
-            int flags = 0;
-            if (info->border_style == 3)
-                flags |= FILTER_BORDER_STYLE_3;
-            if (info->border_x || info->border_y)
-                flags |= FILTER_NONZERO_BORDER;
-            if (info->shadow_x || info->shadow_y)
-                flags |= FILTER_NONZERO_SHADOW;
-            if (flags & FILTER_NONZERO_SHADOW &&
-                (info->effect_type == EF_KARAOKE_KF ||
-                 info->effect_type == EF_KARAOKE_KO ||
-                 _a(info->c[0]) != 0xFF ||
-                 info->border_style == 3))
-                flags |= FILTER_FILL_IN_SHADOW;
-            if (!(flags & FILTER_NONZERO_BORDER) &&
-                !(flags & FILTER_FILL_IN_SHADOW))
-                flags &= ~FILTER_NONZERO_SHADOW;
-            if ((flags & FILTER_NONZERO_BORDER &&
-                 _a(info->c[0]) == 0 &&
-                 _a(info->c[1]) == 0 &&
-                 info->fade == 0) ||
-                info->border_style == 3)
-                flags |= FILTER_FILL_IN_BORDER;
+            int flags = get_filter_flags(info);
 
             if (new_run) {
                 if (nb_bitmaps >= text_info->max_bitmaps) {
@@ -2530,6 +2703,7 @@ static void render_and_combine_glyphs(RenderContext *state,
                 current_info->effect_type = info->effect_type;
                 current_info->effect_timing = info->effect_timing;
                 current_info->leftmost_x = OUTLINE_MAX;
+                current_info->glyph = i;
 
                 FilterDesc *filter = &current_info->filter;
                 filter->flags = flags;
@@ -2548,6 +2722,7 @@ static void render_and_combine_glyphs(RenderContext *state,
                     filter->shadow.y = (y + (shadow_mask_y >> 1)) & ~shadow_mask_y;
                 } else
                     filter->shadow.x = filter->shadow.y = 0;
+                filter->offset = subpixel;
 
                 current_info->x = current_info->y = INT_MAX;
                 current_info->bm = current_info->bm_o = current_info->bm_s = NULL;
@@ -2614,9 +2789,10 @@ static void render_and_combine_glyphs(RenderContext *state,
         key.filter = info->filter;
         key.bitmap_count = info->bitmap_count;
         key.bitmaps = info->bitmaps;
-        CompositeHashValue *val = ass_cache_get(render_priv->cache.composite_cache, &key, render_priv);
+        CompositeHashValue *val = ass_cache_get_composite(render_priv->cache.composite_cache, &key, render_priv);
         if (!val)
             continue;
+        tag_cache_item(state, val);
 
         if (val->bm.buffer)
             info->bm = &val->bm;
@@ -2666,6 +2842,38 @@ int ass_be_padding(int be)
 }
 
 
+/**
+ * \brief Construct a composite shifted by a fraction of a pixel
+ * from the unshifted one, which is shared by all shifts
+ */
+static void construct_shifted_composite(ASS_Renderer *render_priv,
+                                        CompositeHashKey *k,
+                                        CompositeHashValue *v)
+{
+    CompositeHashKey base_key = *k;
+    base_key.filter.offset.x = base_key.filter.offset.y = 0;
+    base_key.bitmaps = ass_realloc_array(NULL, k->bitmap_count, sizeof(BitmapRef));
+    if (!base_key.bitmaps)
+        return;
+    memcpy(base_key.bitmaps, k->bitmaps, k->bitmap_count * sizeof(BitmapRef));
+    CompositeHashValue *base =
+        ass_cache_get_composite(render_priv->cache.composite_cache, &base_key, render_priv);
+    if (!base)
+        return;
+
+    const BitmapEngine *engine = &render_priv->engine;
+    int x = k->filter.offset.x, y = k->filter.offset.y;
+    if (ass_copy_shifted_bitmap(engine, &v->bm, &base->bm, x, y) &&
+            ass_copy_shifted_bitmap(engine, &v->bm_o, &base->bm_o, x, y) &&
+            ass_copy_shifted_bitmap(engine, &v->bm_s, &base->bm_s, x, y))
+        return;
+
+    ass_free_bitmap(&v->bm);
+    ass_free_bitmap(&v->bm_o);
+    ass_free_bitmap(&v->bm_s);
+    memset(v, 0, sizeof(*v));
+}
+
 size_t ass_composite_construct(void *key, void *value, void *priv)
 {
     ASS_Renderer *render_priv = priv;
@@ -2673,6 +2881,11 @@ size_t ass_composite_construct(void *key, void *value, void *priv)
     CompositeHashValue *v = value;
     memset(v, 0, sizeof(*v));
 
+    if (k->filter.offset.x || k->filter.offset.y) {
+        construct_shifted_composite(render_priv, k, v);
+        goto done;
+    }
+
     ASS_Rect rect, rect_o;
     rectangle_reset(&rect);
     rectangle_reset(&rect_o);
@@ -2777,11 +2990,408 @@ size_t ass_composite_construct(void *key, void *value, void *priv)
     if ((flags & FILTER_FILL_IN_SHADOW) && !(flags & FILTER_FILL_IN_BORDER))
         ass_fix_outline(&v->bm, &v->bm_o);
 
+done:
     return sizeof(CompositeHashKey) + sizeof(CompositeHashValue) +
         k->bitmap_count * sizeof(BitmapRef) +
         bitmap_size(&v->bm) + bitmap_size(&v->bm_o) + bitmap_size(&v->bm_s);
 }
 
+static bool init_event_key(ASS_Renderer *priv, EventKey *key,
+                           const ASS_Event *event)
+{
+    key->text = strdup(event->Text);
+    if (!key->text)
+        return false;
+    key->track = priv->track;
+    key->event = (ASS_Event *) event;
+    key->start = event->Start;
+    key->duration = event->Duration;
+    key->read_order = event->ReadOrder;
+    key->layer = event->Layer;
+    key->style = event->Style;
+    key->margin_l = event->MarginL;
+    key->margin_r = event->MarginR;
+    key->margin_v = event->MarginV;
+    key->par_scale_x = priv->par_scale_x;
+    return true;
+}
+
+static void free_event_key(EventKey *key)
+{
+    free(key->text);
+}
+
+static bool is_same_event(ASS_Renderer *priv, const EventKey *key,
+                          const ASS_Event *event)
+{
+    return key->track == priv->track && key->event == event &&
+        key->start == event->Start && key->duration == event->Duration &&
+        key->read_order == event->ReadOrder && key->layer == event->Layer &&
+        key->style == event->Style && key->margin_l == event->MarginL &&
+        key->margin_r == event->MarginR && key->margin_v == event->MarginV &&
+        key->par_scale_x == priv->par_scale_x &&
+        event->Text && !strcmp(key->text, event->Text);
+}
+
+static void fill_glyph_layout_key(GlyphLayoutKey *key, const GlyphInfo *info)
+{
+    key->symbol = info->symbol;
+    key->font = info->font;
+    key->font_size = info->font_size;
+    key->scale_x = info->scale_x;
+    key->scale_y = info->scale_y;
+    key->scale_fix = info->scale_fix;
+    key->border_x = info->border_x;
+    key->border_y = info->border_y;
+    key->hspacing = info->hspacing;
+    key->hspacing_scaled = info->hspacing_scaled;
+    key->drawing_text = info->drawing_text;
+    key->drawing_scale = info->drawing_scale;
+    key->drawing_pbo = info->drawing_pbo;
+    key->bold = info->bold;
+    key->italic = info->italic;
+    key->flags = info->flags;
+    key->starts_new_run = info->starts_new_run;
+}
+
+static bool is_same_glyph_layout(const GlyphLayoutKey *a,
+                                 const GlyphLayoutKey *b)
+{
+    // drawings point into the event text, which is compared separately
+    return a->symbol == b->symbol && a->font == b->font &&
+        a->font_size == b->font_size &&
+        a->scale_x == b->scale_x && a->scale_y == b->scale_y &&
+        a->scale_fix == b->scale_fix &&
+        a->border_x == b->border_x && a->border_y == b->border_y &&
+        a->hspacing == b->hspacing &&
+        a->hspacing_scaled == b->hspacing_scaled &&
+        a->drawing_text.str == b->drawing_text.str &&
+        a->drawing_text.len == b->drawing_text.len &&
+        a->drawing_scale == b->drawing_scale &&
+        a->drawing_pbo == b->drawing_pbo &&
+        a->bold == b->bold && a->italic == b->italic &&
+        a->flags == b->flags && a->starts_new_run == b->starts_new_run;
+}
+
+/**
+ * \brief Collect the layout inputs of the parsed glyphs
+ * \return false if the layout of the event cannot be reused
+ */
+static bool get_layout_keys(RenderContext *state)
+{
+    TextInfo *text_info = &state->text_info;
+    if (text_info->length > state->max_layout_keys) {
+        if (!ASS_REALLOC_ARRAY(state->layout_keys, text_info->max_glyphs))
+            return false;
+        state->max_layout_keys = text_info->max_glyphs;
+    }
+
+    for (int i = 0; i < text_info->length; i++) {
+        const GlyphInfo *info = text_info->glyphs + i;
+        // karaoke is resolved against the positions before reordering
+        if (info->effect_type != EF_NONE)
+            return false;
+        fill_glyph_layout_key(state->layout_keys + i, info);
+    }
+    return true;
+}
+
+static void free_glyph_clusters(GlyphInfo *glyphs, int length)
+{
+    for (int i = 0; i < length; i++) {
+        GlyphInfo *info = glyphs[i].next;
+        while (info) {
+            GlyphInfo *next = info->next;
+            free(info);
+            info = next;
+        }
+        glyphs[i].next = NULL;
+    }
+}
+
+// Copy a chain of cluster continuations, NULL on allocation failure
+static GlyphInfo *copy_cluster(const GlyphInfo *info)
+{
+    GlyphInfo head = {0};
+    GlyphInfo *tail = &head;
+    for (; info; info = info->next) {
+        GlyphInfo *copy = malloc(sizeof(GlyphInfo));
+        if (!copy) {
+            free_glyph_clusters(&head, 1);
+            return NULL;
+        }
+        *copy = *info;
+        copy->next = NULL;
+        tail->next = copy;
+        tail = copy;
+    }
+    return head.next;
+}
+
+/**
+ * \brief Deep copy of a glyph array, including cluster continuations
+ * \return false on allocation failure, dst owns nothing then
+ */
+static bool copy_glyphs(GlyphInfo *dst, const GlyphInfo *src, int length)
+{
+    for (int i = 0; i < length; i++) {
+        dst[i] = src[i];
+        if (!src[i].next)
+            continue;
+        dst[i].next = copy_cluster(src[i].next);
+        if (!dst[i].next) {
+            free_glyph_clusters(dst, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void ref_glyphs(GlyphInfo *glyphs, int length)
+{
+    for (int i = 0; i < length; i++) {
+        for (GlyphInfo *info = glyphs + i; info; info = info->next) {
+            ass_cache_inc_ref(info->font);
+            ass_cache_inc_ref(info->outline);
+        }
+    }
+}
+
+static void unref_glyphs(GlyphInfo *glyphs, int length)
+{
+    for (int i = 0; i < length; i++) {
+        for (GlyphInfo *info = glyphs + i; info; info = info->next) {
+            ass_cache_dec_ref(info->font);
+            ass_cache_dec_ref(info->outline);
+        }
+    }
+}
+
+static void free_layout(EventLayout *layout)
+{
+    unref_glyphs(layout->glyphs, layout->length);
+    free_glyph_clusters(layout->glyphs, layout->length);
+    free(layout->glyphs);
+    free(layout->cmap);
+    free(layout->glyph_keys);
+    free(layout->lines);
+    free_event_key(&layout->key);
+}
+
+void ass_flush_layouts(ASS_Renderer *priv)
+{
+    for (int i = 0; i < priv->n_layouts; i++)
+        free_layout(priv->layouts + i);
+    priv->n_layouts = 0;
+}
+
+/**
+ * \brief Forget layouts of events that were not displayed in this frame
+ */
+static void expire_layouts(ASS_Renderer *priv)
+{
+    int n = 0;
+    for (int i = 0; i < priv->n_layouts; i++) {
+        EventLayout *layout = priv->layouts + i;
+        if (!layout->used) {
+            free_layout(layout);
+            continue;
+        }
+        layout->used = false;
+        priv->layouts[n++] = *layout;
+    }
+    priv->n_layouts = n;
+}
+
+static bool is_same_layout(RenderContext *state, const EventLayout *layout,
+                           double max_text_width)
+{
+    if (layout->length != state->text_info.length ||
+            layout->alignment != state->alignment ||
+            layout->justify != state->justify ||
+            layout->evt_type != state->evt_type ||
+            layout->wrap_style != state->wrap_style ||
+            layout->font_encoding != state->font_encoding ||
+            layout->max_text_width != max_text_width)
+        return false;
+
+    for (int i = 0; i < layout->length; i++)
+        if (!is_same_glyph_layout(layout->glyph_keys + i, state->layout_keys + i))
+            return false;
+    return true;
+}
+
+// Take the glyph properties that do not affect the layout from this frame
+static void apply_glyph_style(GlyphInfo *info, const GlyphInfo *src)
+{
+    for (; info; info = info->next) {
+        memcpy(info->c, src->c, sizeof(info->c));
+        info->fade = src->fade;
+        info->be = src->be;
+        info->blur = src->blur;
+        info->shadow_x = src->shadow_x;
+        info->shadow_y = src->shadow_y;
+        info->frx = src->frx;
+        info->fry = src->fry;
+        info->frz = src->frz;
+        info->fax = src->fax;
+        info->fay = src->fay;
+        info->border_style = src->border_style;
+    }
+}
+
+/**
+ * \brief Replace the parsed glyphs with the layout computed for the event
+ * in an earlier frame, if the animation has not changed any of its inputs
+ * \return false if there is no such layout, text_info is untouched then
+ */
+static bool restore_layout(RenderContext *state, double max_text_width)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    TextInfo *text_info = &state->text_info;
+    bool success = false;
+
+    ass_mutex_lock(&render_priv->layout_lock);
+
+    EventLayout *layout = NULL;
+    for (int i = 0; i < render_priv->n_layouts; i++) {
+        if (is_same_event(render_priv, &render_priv->layouts[i].key, state->event)) {
+            layout = render_priv->layouts + i;
+            break;
+        }
+    }
+    if (!layout || !is_same_layout(state, layout, max_text_width))
+        goto done;
+
+    if (layout->n_lines > text_info->max_lines) {
+        if (!ASS_REALLOC_ARRAY(text_info->lines, layout->n_lines))
+            goto done;
+        text_info->max_lines = layout->n_lines;
+    }
+    if (layout->length > state->max_cmap) {
+        if (!ASS_REALLOC_ARRAY(state->cmap, layout->length))
+            goto done;
+        state->max_cmap = layout->length;
+    }
+
+    // copy cluster continuations first, so that failure leaves
+    // the parsed glyphs intact
+    int length = layout->length;
+    GlyphInfo **clusters = calloc(length, sizeof(GlyphInfo *));
+    if (!clusters)
+        goto done;
+    for (int i = 0; i < length; i++) {
+        if (!layout->glyphs[i].next)
+            continue;
+        clusters[i] = copy_cluster(layout->glyphs[i].next);
+        if (!clusters[i]) {
+            for (int j = 0; j < i; j++) {
+                GlyphInfo head = { .next = clusters[j] };
+                free_glyph_clusters(&head, 1);
+            }
+            free(clusters);
+            goto done;
+        }
+    }
+
+    for (int i = 0; i < length; i++) {
+        GlyphInfo *info = text_info->glyphs + i;
+        GlyphInfo parsed = *info;
+        *info = layout->glyphs[i];
+        info->next = clusters[i];
+        apply_glyph_style(info, &parsed);
+    }
+    free(clusters);
+
+    memcpy(state->cmap, layout->cmap, length * sizeof(FriBidiStrIndex));
+    memcpy(text_info->lines, layout->lines, layout->n_lines * sizeof(LineInfo));
+    text_info->n_lines = layout->n_lines;
+    text_info->height = layout->height;
+    text_info->border_top = layout->border_top;
+    text_info->border_bottom = layout->border_bottom;
+    text_info->border_x = layout->border_x;
+    layout->used = true;
+    success = true;
+
+done:
+    ass_mutex_unlock(&render_priv->layout_lock);
+    return success;
+}
+
+/**
+ * \brief Remember the layout of an animated event for later frames
+ */
+static void store_layout(RenderContext *state, double max_text_width)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    TextInfo *text_info = &state->text_info;
+    int length = text_info->length;
+    if (!length)
+        return;
+
+    EventLayout layout = {0};
+    if (!init_event_key(render_priv, &layout.key, state->event))
+        return;
+    layout.glyph_keys = ass_realloc_array(NULL, length, sizeof(GlyphLayoutKey));
+    layout.glyphs = ass_realloc_array(NULL, length, sizeof(GlyphInfo));
+    layout.cmap = ass_realloc_array(NULL, length, sizeof(FriBidiStrIndex));
+    layout.lines = ass_realloc_array(NULL, text_info->n_lines, sizeof(LineInfo));
+    if (!layout.glyph_keys || !layout.glyphs || !layout.cmap || !layout.lines ||
+            !copy_glyphs(layout.glyphs, text_info->glyphs, length)) {
+        free_layout(&layout);
+        return;
+    }
+    layout.length = length;
+    ref_glyphs(layout.glyphs, length);
+
+    memcpy(layout.glyph_keys, state->layout_keys, length * sizeof(GlyphLayoutKey));
+    memcpy(layout.cmap, ass_shaper_get_reorder_map(state->shaper),
+           length * sizeof(FriBidiStrIndex));
+    memcpy(layout.lines, text_info->lines, text_info->n_lines * sizeof(LineInfo));
+    layout.n_lines = text_info->n_lines;
+    layout.height = text_info->height;
+    layout.border_top = text_info->border_top;
+    layout.border_bottom = text_info->border_bottom;
+    layout.border_x = text_info->border_x;
+    layout.alignment = state->alignment;
+    layout.justify = state->justify;
+    layout.evt_type = state->evt_type;
+    layout.wrap_style = state->wrap_style;
+    layout.font_encoding = state->font_encoding;
+    layout.max_text_width = max_text_width;
+    layout.used = true;
+
+    EventLayout old;
+    bool stored = false, replaced = false;
+
+    ass_mutex_lock(&render_priv->layout_lock);
+    for (int i = 0; i < render_priv->n_layouts; i++) {
+        EventLayout *slot = render_priv->layouts + i;
+        if (is_same_event(render_priv, &slot->key, state->event)) {
+            old = *slot;
+            *slot = layout;
+            stored = replaced = true;
+            break;
+        }
+    }
+    if (!stored && render_priv->n_layouts == render_priv->max_layouts) {
+        int new_max = 2 * render_priv->max_layouts + 16;
+        if (ASS_REALLOC_ARRAY(render_priv->layouts, new_max))
+            render_priv->max_layouts = new_max;
+    }
+    if (!stored && render_priv->n_layouts < render_priv->max_layouts) {
+        render_priv->layouts[render_priv->n_layouts++] = layout;
+        stored = true;
+    }
+    ass_mutex_unlock(&render_priv->layout_lock);
+
+    // dropping references may take cache locks, do it outside
+    if (replaced)
+        free_layout(&old);
+    else if (!stored)
+        free_layout(&layout);
+}
+
 static void add_background(RenderContext *state, EventImages *event_images)
 {
     ASS_Renderer *render_priv = state->renderer;
@@ -2815,40 +3425,124 @@ static void add_background(RenderContext *state, EventImages *event_images)
     }
 }
 
+static void free_color_map(ColorMap *map)
+{
+    if (!map)
+        return;
+    free(map->glyphs);
+    free(map->flags);
+    free(map->run_starts);
+    free(map);
+}
+
 /**
- * \brief Main ass rendering function, glues everything together
- * \param event event to render
- * \param event_images struct containing resulting images, will also be initialized
- * Process event, appending resulting ASS_Image's to images_root.
+ * \brief Remember the style runs of the parsed glyphs.
+ * Layout starts new runs at line breaks and after trimmed whitespace,
+ * so recolor_images() has to compare the runs from before layout.
+ * \return false on allocation failure
  */
-static bool
-ass_render_event(RenderContext *state, ASS_Event *event,
-                 EventImages *event_images)
+static bool store_run_starts(RenderContext *state)
 {
-    ASS_Renderer *render_priv = state->renderer;
-    if (event->Style >= render_priv->track->n_styles) {
-        ass_msg(render_priv->library, MSGL_WARN, "No style found");
-        return false;
+    TextInfo *text_info = &state->text_info;
+    if (text_info->length > state->max_run_starts) {
+        if (!ASS_REALLOC_ARRAY(state->run_starts, text_info->max_glyphs))
+            return false;
+        state->max_run_starts = text_info->max_glyphs;
     }
-    if (!event->Text) {
-        ass_msg(render_priv->library, MSGL_WARN, "Empty event");
-        return false;
+
+    for (int i = 0; i < text_info->length; i++)
+        state->run_starts[i] = text_info->glyphs[i].starts_new_run;
+    return true;
+}
+
+/**
+ * \brief Record where the images of the event get their colors from
+ * \return NULL on allocation failure
+ */
+static ColorMap *get_color_map(RenderContext *state)
+{
+    TextInfo *text_info = &state->text_info;
+    ColorMap *map = calloc(1, sizeof(ColorMap));
+    if (!map)
+        return NULL;
+
+    int n_runs = text_info->n_bitmaps;
+    map->glyphs = ass_realloc_array(NULL, FFMAX(n_runs, 1), sizeof(int));
+    map->flags = ass_realloc_array(NULL, FFMAX(n_runs, 1), sizeof(int));
+    map->run_starts = ass_realloc_array(NULL, text_info->length, sizeof(bool));
+    if (!map->glyphs || !map->flags || !map->run_starts) {
+        free_color_map(map);
+        return NULL;
     }
 
-    free_render_context(state);
-    init_render_context(state, event);
+    map->n_runs = n_runs;
+    for (int i = 0; i < n_runs; i++) {
+        const CombinedBitmapInfo *info = text_info->combined_bitmaps + i;
+        map->glyphs[i] = info->glyph;
+        map->flags[i] = info->filter.flags;
+    }
+    map->length = text_info->length;
+    memcpy(map->run_starts, state->run_starts, text_info->length * sizeof(bool));
+    return map;
+}
 
-    if (!parse_events(state, event))
-        return false;
+static bool copy_images(ASS_Image *src, ASS_Image **dst);
 
+/**
+ * \brief Reuse the images of an event animated only in color,
+ * taking the colors from the freshly parsed glyphs
+ * \return false if the images cannot be reused
+ */
+static bool recolor_images(RenderContext *state, const StaticEvent *se,
+                           EventImages *event_images)
+{
     TextInfo *text_info = &state->text_info;
-    if (text_info->length == 0) {
-        // no valid symbols in the event; this can be smth like {comment}
-        free_render_context(state);
+    const ColorMap *map = se->colors;
+
+    // run boundaries and filters depend on colors as well
+    if (map->length != text_info->length)
+        return false;
+    for (int i = 0; i < map->length; i++)
+        if (map->run_starts[i] != text_info->glyphs[i].starts_new_run)
+            return false;
+    for (int i = 0; i < map->n_runs; i++)
+        if (get_filter_flags(text_info->glyphs + map->glyphs[i]) != map->flags[i])
+            return false;
+
+    ASS_Image *imgs;
+    if (!copy_images(se->images.imgs, &imgs))
         return false;
+
+    for (ASS_Image *img = imgs; img; img = img->next) {
+        int run = ((ASS_ImagePriv *) img)->run;
+        if (run < 0) {
+            // background box
+            img->color = state->c[3];
+            ass_apply_fade(&img->color, state->fade);
+            continue;
+        }
+        const GlyphInfo *info = text_info->glyphs + map->glyphs[run];
+        int index = img->type == IMAGE_TYPE_SHADOW ? 3 :
+                    img->type == IMAGE_TYPE_OUTLINE ? 2 : 0;
+        img->color = info->c[index];
+        ass_apply_fade(&img->color, info->fade);
     }
 
-    split_style_runs(state);
+    *event_images = se->images;
+    event_images->imgs = imgs;
+    event_images->cached = true;
+    event_images->recolor = se;
+    return true;
+}
+
+/**
+ * \brief Shape, wrap, reorder and align the parsed text
+ * Called with font_lock held, releases it.
+ */
+static bool layout_text(RenderContext *state, double max_text_width)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    TextInfo *text_info = &state->text_info;
 
     // Find shape runs and shape text
     ass_shaper_set_base_direction(state->shaper,
@@ -2858,42 +3552,116 @@ ass_render_event(RenderContext *state, ASS_Event *event,
     if (!ass_shaper_shape(state->shaper, text_info)) {
         ass_msg(render_priv->library, MSGL_ERR, "Failed to shape text");
         free_render_context(state);
+        ass_mutex_unlock(&render_priv->font_lock);
         return false;
     }
 
     retrieve_glyphs(state);
 
+    ass_mutex_unlock(&render_priv->font_lock);
+
     preliminary_layout(state);
 
-    int valign = state->alignment & 12;
+    // wrap lines
+    wrap_lines_smart(state, max_text_width);
 
-    int MarginL =
-        (event->MarginL) ? event->MarginL : state->style->MarginL;
-    int MarginR =
-        (event->MarginR) ? event->MarginR : state->style->MarginR;
-    int MarginV =
-        (event->MarginV) ? event->MarginV : state->style->MarginV;
+    // depends on glyph x coordinates being monotonous within runs, so it should be done before reorder
+    ass_process_karaoke_effects(state);
+
+    reorder_text(state);
+
+    align_lines(state, max_text_width);
+    return true;
+}
+
+/**
+ * \brief Main ass rendering function, glues everything together
+ * \param event event to render
+ * \param event_images struct containing resulting images, will also be initialized
+ * Process event, appending resulting ASS_Image's to images_root.
+ */
+static bool
+ass_render_event(RenderContext *state, ASS_Event *event,
+                 EventImages *event_images)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    if (event->Style >= render_priv->track->n_styles) {
+        ass_msg(render_priv->library, MSGL_WARN, "No style found");
+        return false;
+    }
+    if (!event->Text) {
+        ass_msg(render_priv->library, MSGL_WARN, "Empty event");
+        return false;
+    }
+
+    // everything up to and including glyph retrieval may touch fonts
+    ass_mutex_lock(&render_priv->font_lock);
+
+    free_render_context(state);
+    init_render_context(state, event);
+
+    if (!parse_events(state, event)) {
+        ass_mutex_unlock(&render_priv->font_lock);
+        return false;
+    }
+
+    TextInfo *text_info = &state->text_info;
+    if (text_info->length == 0) {
+        // no valid symbols in the event; this can be smth like {comment}
+        free_render_context(state);
+        ass_mutex_unlock(&render_priv->font_lock);
+        return false;
+    }
+
+    split_style_runs(state);
+
+    const StaticEvent *recolor = event_images->recolor;
+    if (recolor && !state->animated_geometry && !state->animated_position &&
+            recolor_images(state, recolor, event_images)) {
+        free_render_context(state);
+        ass_mutex_unlock(&render_priv->font_lock);
+        return true;
+    }
+
+    // only colors change, the images can be reused in later frames
+    bool recolorable = state->animated &&
+        !state->animated_geometry && !state->animated_position &&
+        store_run_starts(state);
+
+    int valign = state->alignment & 12;
+
+    int MarginL =
+        (event->MarginL) ? event->MarginL : state->style->MarginL;
+    int MarginR =
+        (event->MarginR) ? event->MarginR : state->style->MarginR;
+    int MarginV =
+        (event->MarginV) ? event->MarginV : state->style->MarginV;
 
     // calculate max length of a line
     double max_text_width =
         x2scr_right(state, render_priv->track->PlayResX - MarginR) -
         x2scr_left(state, MarginL);
 
-    // wrap lines
-    wrap_lines_smart(state, max_text_width);
-
-    // depends on glyph x coordinates being monotonous within runs, so it should be done before reorder
-    ass_process_karaoke_effects(state);
-
-    reorder_text(state);
-
-    align_lines(state, max_text_width);
+    // animated events often keep their layout from frame to frame
+    bool cache_layout = state->animated && get_layout_keys(state);
+    const FriBidiStrIndex *cmap;
+    if (cache_layout && restore_layout(state, max_text_width)) {
+        ass_mutex_unlock(&render_priv->font_lock);
+        // the shaper did not run, its map belongs to another event
+        cmap = state->cmap;
+    } else {
+        if (!layout_text(state, max_text_width))
+            return false;
+        if (cache_layout)
+            store_layout(state, max_text_width);
+        cmap = ass_shaper_get_reorder_map(state->shaper);
+    }
 
     // determine text bounding box
     ASS_DRect bbox;
     compute_string_bbox(text_info, &bbox);
 
-    apply_baseline_shear(state);
+    apply_baseline_shear(state, cmap);
 
     // determine device coordinates for text
     double device_x = 0;
@@ -3029,23 +3797,85 @@ ass_render_event(RenderContext *state, ASS_Event *event,
         + 2 * text_info->border_x + 0.5;
     event_images->detect_collisions = state->detect_collisions;
     event_images->shift_direction = (valign == VALIGN_SUB) ? -1 : 1;
+    event_images->animated = state->animated;
     event_images->event = event;
     event_images->imgs = render_text(state);
 
     if (state->border_style == 4)
         add_background(state, event_images);
 
+    if (recolorable)
+        event_images->colors = get_color_map(state);
+
     ass_shaper_cleanup(state->shaper, text_info);
     free_render_context(state);
 
     return true;
 }
 
+/**
+ * \brief Divide the unified budget among the caches and cut them.
+ * Each cache gets a share proportional to the total time it took to
+ * construct its current items; caches that already fit into their share
+ * keep their size and leave the rest to the others.
+ */
+static void cut_cache_budget(CacheStore *cache)
+{
+    // users of other cache items come first, so that cutting them
+    // releases references before the referenced caches are cut
+    Cache *caches[] = {
+        cache->composite_cache, cache->bitmap_cache, cache->outline_cache,
+        cache->metrics_cache, cache->face_size_metrics_cache, cache->font_cache,
+    };
+    enum { N_CACHES = sizeof(caches) / sizeof(*caches) };
+
+    size_t bytes[N_CACHES], total = 0;
+    double cost[N_CACHES];
+    for (int i = 0; i < N_CACHES; i++) {
+        ASS_CacheCounters stats;
+        ass_cache_get_stats(caches[i], &stats);
+        bytes[i] = stats.bytes;
+        total += stats.bytes;
+        double item_cost = stats.constructions ?
+            (double) stats.construct_time / stats.constructions : 0;
+        cost[i] = FFMAX(item_cost, 1) * stats.items;
+    }
+    if (total <= cache->budget)
+        return;
+
+    bool fits[N_CACHES] = {0};
+    size_t left = cache->budget;
+    double cost_left = 0;
+    for (int i = 0; i < N_CACHES; i++)
+        cost_left += cost[i];
+    bool changed;
+    do {
+        changed = false;
+        for (int i = 0; i < N_CACHES; i++) {
+            if (fits[i] || bytes[i] > left * (cost[i] / cost_left))
+                continue;
+            fits[i] = changed = true;
+            left -= bytes[i];
+            cost_left -= cost[i];
+        }
+    } while (changed && cost_left > 0);
+
+    for (int i = 0; i < N_CACHES; i++)
+        if (!fits[i])
+            ass_cache_cut_resident(caches[i], left * (cost[i] / cost_left));
+}
+
 /**
  * \brief Check cache limits and reset cache if they are exceeded
  */
 static void check_cache_limits(ASS_Renderer *priv, CacheStore *cache)
 {
+    ass_cache_set_time(cache->composite_cache, priv->time, cache->lookahead);
+    ass_cache_set_time(cache->bitmap_cache, priv->time, cache->lookahead);
+    if (cache->budget) {
+        cut_cache_budget(cache);
+        return;
+    }
     ass_cache_cut(cache->composite_cache, cache->composite_max_size);
     ass_cache_cut(cache->bitmap_cache, cache->bitmap_max_size);
     ass_cache_cut(cache->outline_cache, cache->glyph_max);
@@ -3093,11 +3923,15 @@ ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
 
     if (render_priv->library->num_fontdata != render_priv->num_emfonts) {
         assert(render_priv->library->num_fontdata > render_priv->num_emfonts);
+        ass_flush_static_events(render_priv);
+        ass_flush_layouts(render_priv);
         render_priv->num_emfonts = ass_update_embedded_fonts(
             render_priv->fontselect, render_priv->num_emfonts);
     }
 
     setup_shaper(render_priv->state.shaper, render_priv);
+    for (int i = 0; i < render_priv->threads.n_workers; i++)
+        setup_shaper(render_priv->threads.workers[i].state.shaper, render_priv);
 
     // PAR correction
     double par = render_priv->settings.par;
@@ -3365,6 +4199,625 @@ static int ass_detect_change(ASS_Renderer *priv)
     return diff;
 }
 
+typedef struct image_ref {
+    const ASS_Image *img;
+    int index;                  // position in the image list
+    bool matched;
+} ImageRef;
+
+#define CMP_FIELD(a, b) if ((a) != (b)) return (a) < (b) ? -1 : 1
+
+/**
+ * \brief Order images by everything that affects their pixels.
+ * Bitmaps are compared by address: both lists hold references
+ * to their bitmaps, so equal addresses mean equal contents.
+ */
+static int cmp_image_content(const ASS_Image *a, const ASS_Image *b)
+{
+    CMP_FIELD((uintptr_t) a->bitmap, (uintptr_t) b->bitmap);
+    CMP_FIELD(a->w, b->w);
+    CMP_FIELD(a->h, b->h);
+    CMP_FIELD(a->stride, b->stride);
+    CMP_FIELD(a->color, b->color);
+    CMP_FIELD(a->dst_x, b->dst_x);
+    CMP_FIELD(a->dst_y, b->dst_y);
+    return 0;
+}
+
+#undef CMP_FIELD
+
+static int cmp_image_ref(const void *a, const void *b)
+{
+    const ImageRef *ra = a, *rb = b;
+    int cmp = cmp_image_content(ra->img, rb->img);
+    return cmp ? cmp : ra->index - rb->index;
+}
+
+/**
+ * \brief Find the first image identical to img at index min_index or later
+ * \return NULL if there is none
+ */
+static ImageRef *find_image_ref(ImageRef *refs, int n,
+                                const ASS_Image *img, int min_index)
+{
+    ImageRef key = { .img = img, .index = min_index };
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (cmp_image_ref(refs + mid, &key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < n && !cmp_image_content(refs[lo].img, img))
+        return refs + lo;
+    return NULL;
+}
+
+/**
+ * \brief Add the area of an image to ASS_Renderer.dirty_rects.
+ * Overlapping rectangles are merged, so that every pixel is reported once.
+ */
+static void add_dirty_rect(ASS_Renderer *priv, const ASS_Image *img)
+{
+    if (!img->w || !img->h)
+        return;
+
+    int x_min = img->dst_x, x_max = img->dst_x + img->w;
+    int y_min = img->dst_y, y_max = img->dst_y + img->h;
+    ASS_DirtyRect *rects = priv->dirty_rects;
+    for (int i = 0; i < priv->n_dirty_rects; i++) {
+        ASS_DirtyRect *r = rects + i;
+        if (r->x >= x_max || r->x + r->w <= x_min ||
+                r->y >= y_max || r->y + r->h <= y_min)
+            continue;
+        x_min = FFMIN(x_min, r->x);
+        y_min = FFMIN(y_min, r->y);
+        x_max = FFMAX(x_max, r->x + r->w);
+        y_max = FFMAX(y_max, r->y + r->h);
+        *r = rects[--priv->n_dirty_rects];
+        // the union can overlap rectangles checked before
+        i = -1;
+    }
+
+    if (priv->n_dirty_rects == MAX_DIRTY_RECTS) {
+        // too fragmented, fall back to the bounding box
+        for (int i = 0; i < MAX_DIRTY_RECTS; i++) {
+            x_min = FFMIN(x_min, rects[i].x);
+            y_min = FFMIN(y_min, rects[i].y);
+            x_max = FFMAX(x_max, rects[i].x + rects[i].w);
+            y_max = FFMAX(y_max, rects[i].y + rects[i].h);
+        }
+        priv->n_dirty_rects = 0;
+    }
+
+    ASS_DirtyRect *r = rects + priv->n_dirty_rects++;
+    r->x = x_min;
+    r->y = y_min;
+    r->w = x_max - x_min;
+    r->h = y_max - y_min;
+}
+
+/**
+ * \brief Find the regions that differ between the current
+ * and the previous image list.
+ * Images of the current list are matched in order to identical images
+ * of the previous list. Pixels covered only by matched images are blended
+ * from the same images in the same order, so only the areas of unmatched
+ * images of either list are reported.
+ */
+static void update_dirty_rects(ASS_Renderer *priv)
+{
+    priv->n_dirty_rects = 0;
+
+    // the common case of identical lists needs no matching
+    int n = 0;
+    ASS_Image *img = priv->prev_images_root;
+    ASS_Image *img2 = priv->images_root;
+    for (; img && img2; img = img->next, img2 = img2->next, n++)
+        if (ass_image_compare(img, img2))
+            break;
+    if (!img && !img2)
+        return;
+
+    for (ASS_Image *cur = img; cur; cur = cur->next)
+        n++;
+    if (n > priv->max_image_refs) {
+        int new_max = FFMAX(n, 2 * priv->max_image_refs);
+        if (!ASS_REALLOC_ARRAY(priv->image_refs, new_max)) {
+            // report every image of both lists
+            for (img = priv->prev_images_root; img; img = img->next)
+                add_dirty_rect(priv, img);
+            for (img = priv->images_root; img; img = img->next)
+                add_dirty_rect(priv, img);
+            return;
+        }
+        priv->max_image_refs = new_max;
+    }
+
+    ImageRef *refs = priv->image_refs;
+    n = 0;
+    for (img = priv->prev_images_root; img; img = img->next, n++) {
+        refs[n].img = img;
+        refs[n].index = n;
+        refs[n].matched = false;
+    }
+    if (n > 1)
+        qsort(refs, n, sizeof(ImageRef), cmp_image_ref);
+
+    int last = -1;
+    for (img = priv->images_root; img; img = img->next) {
+        ImageRef *ref = find_image_ref(refs, n, img, last + 1);
+        if (ref) {
+            ref->matched = true;
+            last = ref->index;
+        } else {
+            add_dirty_rect(priv, img);
+        }
+    }
+    for (int i = 0; i < n; i++)
+        if (!refs[i].matched)
+            add_dirty_rect(priv, refs[i].img);
+}
+
+int ass_get_dirty_rects(ASS_Renderer *priv, const ASS_DirtyRect **rects)
+{
+    // computed on demand, the previous list is kept until the next frame
+    if (priv->n_dirty_rects < 0)
+        update_dirty_rects(priv);
+    *rects = priv->dirty_rects;
+    return priv->n_dirty_rects;
+}
+
+/**
+ * \brief Render queued events from ASS_Renderer.eimg until none are left
+ * Events that fail to render get their slot's event pointer cleared.
+ */
+static void render_queued_events(ASS_Renderer *priv, RenderContext *state)
+{
+    RenderThreads *threads = &priv->threads;
+    while (true) {
+        ass_mutex_lock(&threads->lock);
+        int i = threads->next_event;
+        if (i < threads->n_events)
+            threads->next_event++;
+        ass_mutex_unlock(&threads->lock);
+        if (i >= threads->n_events)
+            break;
+
+        EventImages *event_images = priv->eimg + i;
+        if (event_images->cached)
+            continue;
+        if (!ass_render_event(state, event_images->event, event_images))
+            event_images->event = NULL;
+    }
+}
+
+static inline bool raster_jobs_left(const RenderThreads *threads)
+{
+    return threads->raster && threads->next_raster_job < threads->n_raster_jobs;
+}
+
+/**
+ * \brief Fill queued rasterizer jobs until none are left
+ * Must be called with the lock held, which is released while filling.
+ */
+static void fill_raster_jobs(RenderThreads *threads, RasterizerData *rst)
+{
+    while (raster_jobs_left(threads)) {
+        const RasterizerData *src = threads->raster;
+        size_t i = threads->next_raster_job++;
+        ass_mutex_unlock(&threads->lock);
+
+        bool res = ass_rasterizer_fill_job(rst, src, i);
+
+        ass_mutex_lock(&threads->lock);
+        if (!res)
+            threads->raster_failed = true;
+        if (++threads->finished_raster_jobs == threads->n_raster_jobs)
+            ass_cond_signal(&threads->raster_done);
+    }
+}
+
+/**
+ * \brief RasterizerDispatchFunc using the worker pool
+ * Only one outline at a time is shared with other threads,
+ * jobs of concurrent outlines are filled by their own thread.
+ */
+static bool dispatch_raster_jobs(void *priv, const RasterizerData *src, size_t n_jobs)
+{
+    RenderThreads *threads = &((ASS_Renderer *) priv)->threads;
+    // the source rasterizer is idle, so the owning thread fills its jobs with it
+    RasterizerData *rst = (RasterizerData *) src;
+
+    ass_mutex_lock(&threads->lock);
+    if (threads->raster || n_jobs < 2) {
+        ass_mutex_unlock(&threads->lock);
+        bool res = true;
+        for (size_t i = 0; i < n_jobs; i++)
+            res &= ass_rasterizer_fill_job(rst, src, i);
+        return res;
+    }
+
+    threads->raster = src;
+    threads->n_raster_jobs = n_jobs;
+    threads->next_raster_job = threads->finished_raster_jobs = 0;
+    threads->raster_failed = false;
+    ass_cond_broadcast(&threads->start);
+    ass_cond_signal(&threads->done);
+
+    fill_raster_jobs(threads, rst);
+    while (threads->finished_raster_jobs < n_jobs)
+        ass_cond_wait(&threads->raster_done, &threads->lock);
+    bool res = !threads->raster_failed;
+    threads->raster = NULL;
+    ass_mutex_unlock(&threads->lock);
+    return res;
+}
+
+static void render_worker(void *arg)
+{
+    RenderWorker *worker = arg;
+    RenderThreads *threads = &worker->state.renderer->threads;
+
+    unsigned generation = 0;
+    ass_mutex_lock(&threads->lock);
+    while (true) {
+        while (!threads->quit && threads->generation == generation &&
+                !raster_jobs_left(threads))
+            ass_cond_wait(&threads->start, &threads->lock);
+        if (threads->quit)
+            break;
+        if (raster_jobs_left(threads)) {
+            fill_raster_jobs(threads, &worker->state.rasterizer);
+            continue;
+        }
+        generation = threads->generation;
+        ass_mutex_unlock(&threads->lock);
+
+        render_queued_events(worker->state.renderer, &worker->state);
+
+        ass_mutex_lock(&threads->lock);
+        if (!--threads->pending)
+            ass_cond_signal(&threads->done);
+    }
+    ass_mutex_unlock(&threads->lock);
+}
+
+static bool start_threads(ASS_Renderer *priv, int n_workers)
+{
+    RenderThreads *threads = &priv->threads;
+    RenderWorker *workers = calloc(n_workers, sizeof(RenderWorker));
+    if (!workers)
+        return false;
+    if (!ass_mutex_init(&threads->lock))
+        goto fail_workers;
+    if (!ass_cond_init(&threads->start))
+        goto fail_lock;
+    if (!ass_cond_init(&threads->done))
+        goto fail_start;
+    if (!ass_cond_init(&threads->raster_done))
+        goto fail_done;
+
+    threads->workers = workers;
+    threads->n_workers = 0;
+    threads->generation = 0;
+    threads->pending = 0;
+    threads->n_events = threads->next_event = 0;
+    threads->quit = false;
+    threads->raster = NULL;
+    threads->n_raster_jobs = threads->next_raster_job = 0;
+    threads->finished_raster_jobs = 0;
+    threads->raster_failed = false;
+    for (int i = 0; i < n_workers; i++) {
+        RenderWorker *worker = workers + i;
+        if (!render_context_init(&worker->state, priv)) {
+            render_context_done(&worker->state);
+            break;
+        }
+        worker->state.rasterizer.dispatch = dispatch_raster_jobs;
+        worker->state.rasterizer.dispatch_priv = priv;
+        if (!ass_thread_create(&worker->thread, render_worker, worker)) {
+            render_context_done(&worker->state);
+            break;
+        }
+        threads->n_workers++;
+    }
+    if (threads->n_workers) {
+        priv->state.rasterizer.dispatch = dispatch_raster_jobs;
+        priv->state.rasterizer.dispatch_priv = priv;
+        return true;
+    }
+
+    threads->workers = NULL;
+    ass_cond_destroy(&threads->raster_done);
+fail_done:
+    ass_cond_destroy(&threads->done);
+fail_start:
+    ass_cond_destroy(&threads->start);
+fail_lock:
+    ass_mutex_destroy(&threads->lock);
+fail_workers:
+    free(workers);
+    return false;
+}
+
+static void stop_threads(ASS_Renderer *priv)
+{
+    RenderThreads *threads = &priv->threads;
+    if (!threads->n_workers)
+        return;
+
+    priv->state.rasterizer.dispatch = NULL;
+    priv->state.rasterizer.dispatch_priv = NULL;
+
+    ass_mutex_lock(&threads->lock);
+    threads->quit = true;
+    ass_cond_broadcast(&threads->start);
+    ass_mutex_unlock(&threads->lock);
+
+    for (int i = 0; i < threads->n_workers; i++) {
+        ass_thread_join(threads->workers[i].thread);
+        render_context_done(&threads->workers[i].state);
+    }
+
+    ass_cond_destroy(&threads->raster_done);
+    ass_cond_destroy(&threads->done);
+    ass_cond_destroy(&threads->start);
+    ass_mutex_destroy(&threads->lock);
+    free(threads->workers);
+    threads->workers = NULL;
+    threads->n_workers = 0;
+}
+
+int ass_set_threads(ASS_Renderer *priv, int threads)
+{
+    if (threads <= 0)
+        threads = ass_get_cpu_count();
+    threads = FFMINMAX(threads, 1, MAX_RENDER_THREADS);
+
+    if (threads != priv->threads.n_workers + 1) {
+        stop_threads(priv);
+        if (threads > 1 && !start_threads(priv, threads - 1))
+            ass_msg(priv->library, MSGL_WARN,
+                    "Failed to start render threads, rendering single-threaded");
+    }
+    return priv->threads.n_workers + 1;
+}
+
+/**
+ * \brief Copy an image list for use in another frame
+ * Bitmaps are shared with the source list, owned buffers are reference counted.
+ * \return false on allocation failure
+ */
+static bool copy_images(ASS_Image *src, ASS_Image **dst)
+{
+    ASS_Image *head = NULL;
+    ASS_Image **tail = &head;
+    for (; src; src = src->next) {
+        ASS_ImagePriv *src_priv = (ASS_ImagePriv *) src;
+        if (src_priv->buffer && !src_priv->buffer_refs) {
+            src_priv->buffer_refs = malloc(sizeof(size_t));
+            if (!src_priv->buffer_refs)
+                goto fail;
+            *src_priv->buffer_refs = 1;
+        }
+        ASS_ImagePriv *img = malloc(sizeof(ASS_ImagePriv));
+        if (!img)
+            goto fail;
+        *img = *src_priv;
+        img->ref_count = 0;
+        if (img->buffer_refs)
+            ass_atomic_add(img->buffer_refs, 1);
+        ass_cache_inc_ref(img->source);
+        *tail = &img->result;
+        tail = &img->result.next;
+    }
+    *tail = NULL;
+    *dst = head;
+    return true;
+
+fail:
+    *tail = NULL;
+    ass_frame_ref(head);
+    ass_frame_unref(head);
+    return false;
+}
+
+static void free_static_event(StaticEvent *se)
+{
+    ass_frame_ref(se->images.imgs);
+    ass_frame_unref(se->images.imgs);
+    free_color_map(se->colors);
+    free_event_key(&se->key);
+}
+
+void ass_flush_static_events(ASS_Renderer *priv)
+{
+    for (int i = 0; i < priv->n_static_events; i++)
+        free_static_event(priv->static_events + i);
+    priv->n_static_events = 0;
+}
+
+/**
+ * \brief Fill the slots of ASS_Renderer.eimg for events
+ * rendered in a previous frame without animation,
+ * and point events animated only in color to their previous images
+ */
+static void reuse_static_events(ASS_Renderer *priv, int cnt)
+{
+    for (int i = 0; i < priv->n_static_events; i++)
+        priv->static_events[i].used = false;
+
+    for (int i = 0; i < cnt; i++) {
+        EventImages *event_images = priv->eimg + i;
+        event_images->cached = false;
+        event_images->colors = NULL;
+        event_images->recolor = NULL;
+        for (int j = 0; j < priv->n_static_events; j++) {
+            StaticEvent *se = priv->static_events + j;
+            if (se->used || !is_same_event(priv, &se->key, event_images->event))
+                continue;
+            if (se->colors) {
+                // recolored while rendering, marked as used afterwards
+                event_images->recolor = se;
+                break;
+            }
+            ASS_Image *imgs;
+            if (copy_images(se->images.imgs, &imgs)) {
+                *event_images = se->images;
+                event_images->imgs = imgs;
+                event_images->cached = true;
+                se->used = true;
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * \brief Remember newly rendered events without animation or animated
+ * only in color, and forget events that are no longer displayed
+ */
+static void update_static_events(ASS_Renderer *priv, int cnt)
+{
+    for (int i = 0; i < cnt; i++) {
+        EventImages *event_images = priv->eimg + i;
+        if (event_images->cached && event_images->recolor)
+            ((StaticEvent *) event_images->recolor)->used = true;
+        event_images->recolor = NULL;
+    }
+
+    int n = 0;
+    for (int i = 0; i < priv->n_static_events; i++) {
+        StaticEvent *se = priv->static_events + i;
+        if (se->used)
+            priv->static_events[n++] = *se;
+        else
+            free_static_event(se);
+    }
+    priv->n_static_events = n;
+
+    for (int i = 0; i < cnt; i++) {
+        EventImages *event_images = priv->eimg + i;
+        ColorMap *colors = event_images->colors;
+        event_images->colors = NULL;
+        if (event_images->cached || (event_images->animated && !colors))
+            continue;
+
+        if (priv->n_static_events == priv->max_static_events) {
+            int new_max = 2 * priv->max_static_events + 16;
+            if (!ASS_REALLOC_ARRAY(priv->static_events, new_max)) {
+                free_color_map(colors);
+                continue;
+            }
+            priv->max_static_events = new_max;
+        }
+
+        StaticEvent *se = priv->static_events + priv->n_static_events;
+        if (!init_event_key(priv, &se->key, event_images->event)) {
+            free_color_map(colors);
+            continue;
+        }
+        if (!copy_images(event_images->imgs, &se->images.imgs)) {
+            free_event_key(&se->key);
+            free_color_map(colors);
+            continue;
+        }
+        ASS_Image *imgs = se->images.imgs;
+        se->images = *event_images;
+        se->images.imgs = imgs;
+        se->colors = colors;
+        se->used = true;
+        priv->n_static_events++;
+    }
+}
+
+/**
+ * \brief Render the first cnt events queued in ASS_Renderer.eimg
+ * Uses the worker pool if available. Output only depends on the
+ * event order in eimg, not on which thread rendered which event.
+ * \return number of successfully rendered events, compacted to the front
+ */
+static int render_events(ASS_Renderer *priv, int cnt)
+{
+    RenderThreads *threads = &priv->threads;
+    if (threads->n_workers && cnt > 1) {
+        ass_mutex_lock(&threads->lock);
+        threads->n_events = cnt;
+        threads->next_event = 0;
+        threads->pending = threads->n_workers;
+        threads->generation++;
+        ass_cond_broadcast(&threads->start);
+        ass_mutex_unlock(&threads->lock);
+
+        render_queued_events(priv, &priv->state);
+
+        // help with large outlines of the remaining events while waiting
+        ass_mutex_lock(&threads->lock);
+        while (threads->pending) {
+            if (raster_jobs_left(threads))
+                fill_raster_jobs(threads, &priv->state.rasterizer);
+            else
+                ass_cond_wait(&threads->done, &threads->lock);
+        }
+        ass_mutex_unlock(&threads->lock);
+    } else {
+        for (int i = 0; i < cnt; i++) {
+            EventImages *event_images = priv->eimg + i;
+            if (event_images->cached)
+                continue;
+            if (!ass_render_event(&priv->state, event_images->event, event_images))
+                event_images->event = NULL;
+        }
+    }
+
+    int n = 0;
+    for (int i = 0; i < cnt; i++)
+        if (priv->eimg[i].event)
+            priv->eimg[n++] = priv->eimg[i];
+    return n;
+}
+
+static void add_active_event(ASS_Renderer *priv, int cnt, ASS_Event *event)
+{
+    if (cnt >= priv->eimg_size) {
+        priv->eimg_size += 100;
+        priv->eimg =
+            realloc(priv->eimg,
+                    priv->eimg_size * sizeof(EventImages));
+    }
+    priv->eimg[cnt].event = event;
+}
+
+/**
+ * \brief Queue events displayed at time now in ASS_Renderer.eimg
+ * in the order of the track.
+ * \return number of queued events
+ */
+static int collect_active_events(ASS_Renderer *priv, ASS_Track *track,
+                                 long long now)
+{
+    int cnt = 0;
+    EventIndex *index = &track->parser_priv->event_index;
+    if (ass_event_index_update(index, track)) {
+        const int *eids;
+        int n = ass_event_index_find(index, now, &eids);
+        for (; cnt < n; cnt++)
+            add_active_event(priv, cnt, track->events + eids[cnt]);
+        return cnt;
+    }
+
+    // no memory for the index, fall back to a linear scan
+    for (int i = 0; i < track->n_events; i++) {
+        ASS_Event *event = track->events + i;
+        if ((event->Start <= now)
+            && (now < (event->Start + event->Duration)))
+            add_active_event(priv, cnt++, event);
+    }
+    return cnt;
+}
+
 /**
  * \brief render a frame
  * \param priv library handle
@@ -3377,29 +4830,29 @@ static int ass_detect_change(ASS_Renderer *priv)
 ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
                             long long now, int *detect_change)
 {
+    // free the list kept for ass_get_dirty_rects()
+    ass_frame_unref(priv->prev_images_root);
+    priv->prev_images_root = NULL;
+    priv->n_dirty_rects = -1;
+
     // init frame
     if (!ass_start_frame(priv, track, now)) {
         if (detect_change)
             *detect_change = 2;
+        // the next frame is compared to the empty list returned here
+        priv->prev_images_root = priv->images_root;
+        priv->images_root = NULL;
         return NULL;
     }
 
-    // render events separately
-    int cnt = 0;
-    for (int i = 0; i < track->n_events; i++) {
-        ASS_Event *event = track->events + i;
-        if ((event->Start <= now)
-            && (now < (event->Start + event->Duration))) {
-            if (cnt >= priv->eimg_size) {
-                priv->eimg_size += 100;
-                priv->eimg =
-                    realloc(priv->eimg,
-                            priv->eimg_size * sizeof(EventImages));
-            }
-            if (ass_render_event(&priv->state, event, priv->eimg + cnt))
-                cnt++;
-        }
-    }
+    // collect active events
+    int cnt = collect_active_events(priv, track, now);
+
+    // render events separately, reusing the images of unanimated ones
+    reuse_static_events(priv, cnt);
+    cnt = render_events(priv, cnt);
+    update_static_events(priv, cnt);
+    expire_layouts(priv);
 
     // sort by layer
     if (cnt > 0)
@@ -3430,16 +4883,21 @@ ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
     if (detect_change)
         *detect_change = ass_detect_change(priv);
 
-    // free the previous image list
-    ass_frame_unref(priv->prev_images_root);
-    priv->prev_images_root = NULL;
-
     if (track->parser_priv->prune_delay >= 0)
         ass_prune_events(track, now - track->parser_priv->prune_delay);
 
     return priv->images_root;
 }
 
+const ASS_Atlas *ass_render_frame_atlas(ASS_Renderer *priv, ASS_Track *track,
+                                        long long now, int *detect_change)
+{
+    ASS_Image *images = ass_render_frame(priv, track, now, detect_change);
+    if (!ass_atlas_update(&priv->atlas, images, priv->width))
+        return NULL;
+    return &priv->atlas.out;
+}
+
 /**
  * \brief Add reference to a frame image list.
  * \param image_list image list returned by ass_render_frame()
@@ -3463,7 +4921,214 @@ void ass_frame_unref(ASS_Image *img)
         ASS_ImagePriv *priv = (ASS_ImagePriv *) img;
         img = img->next;
         ass_cache_dec_ref(priv->source);
-        ass_aligned_free(priv->buffer);
+        if (!priv->buffer_refs) {
+            ass_aligned_free(priv->buffer);
+        } else if (!ass_atomic_sub(priv->buffer_refs, 1)) {
+            ass_aligned_free(priv->buffer);
+            free(priv->buffer_refs);
+        }
         free(priv);
     } while (img);
 }
+
+void ass_blend_frame_rgba(ASS_Renderer *priv, const ASS_Image *images,
+                          unsigned char *frame, int stride,
+                          int width, int height, int flags)
+{
+    BlendRGBAFunc *blend = flags & ASS_BLEND_STRAIGHT ?
+        priv->engine.blend_rgba_straight : priv->engine.blend_rgba;
+
+    for (const ASS_Image *img = images; img; img = img->next) {
+        int x_min = FFMAX(img->dst_x, 0);
+        int y_min = FFMAX(img->dst_y, 0);
+        int x_max = FFMIN(img->dst_x + img->w, width);
+        int y_max = FFMIN(img->dst_y + img->h, height);
+        uint32_t opacity = 255 - (img->color & 0xFF);
+        if (x_min >= x_max || y_min >= y_max || !opacity)
+            continue;
+
+        uint32_t r = img->color >> 24;
+        uint32_t g = (img->color >> 16) & 0xFF;
+        uint32_t b = (img->color >> 8) & 0xFF;
+        uint32_t color = flags & ASS_BLEND_BGRA ?
+            b | g << 8 | r << 16 | opacity << 24 :
+            r | g << 8 | b << 16 | opacity << 24;
+
+        const uint8_t *src = img->bitmap +
+            (ptrdiff_t) (y_min - img->dst_y) * img->stride + (x_min - img->dst_x);
+        uint8_t *dst = frame + (ptrdiff_t) y_min * stride + 4 * x_min;
+        blend(dst, stride, src, img->stride, x_max - x_min, y_max - y_min, color);
+    }
+}
+
+/**
+ * \brief Pick the matrix for converting subtitle colors as recommended
+ * in the description of ASS_YCbCrMatrix
+ */
+static ASS_YCbCrMatrix select_yuv_matrix(const ASS_Track *track,
+                                         ASS_YCbCrMatrix video_matrix)
+{
+    if (video_matrix <= YCBCR_NONE)
+        video_matrix = YCBCR_BT601_TV;
+    if (!track)
+        return video_matrix;
+
+    switch (track->YCbCrMatrix) {
+    case YCBCR_NONE:
+        return video_matrix;
+    case YCBCR_DEFAULT:
+    case YCBCR_UNKNOWN:
+        return YCBCR_BT601_TV;
+    default:
+        return track->YCbCrMatrix;
+    }
+}
+
+/**
+ * \brief Convert the RGB part of an ASS_Image color
+ * to Y, Cb and Cr values of the given bit depth
+ */
+static void rgb_to_yuv(uint32_t color, ASS_YCbCrMatrix matrix,
+                       int bits, int32_t yuv[3])
+{
+    bool full_range =
+        matrix == YCBCR_BT601_PC || matrix == YCBCR_BT709_PC ||
+        matrix == YCBCR_SMPTE240M_PC || matrix == YCBCR_FCC_PC;
+    double kr, kb;
+    switch (matrix) {
+    case YCBCR_BT709_TV:
+    case YCBCR_BT709_PC:
+        kr = 0.2126;
+        kb = 0.0722;
+        break;
+    case YCBCR_SMPTE240M_TV:
+    case YCBCR_SMPTE240M_PC:
+        kr = 0.212;
+        kb = 0.087;
+        break;
+    case YCBCR_FCC_TV:
+    case YCBCR_FCC_PC:
+        kr = 0.30;
+        kb = 0.11;
+        break;
+    default:
+        kr = 0.299;
+        kb = 0.114;
+    }
+
+    double r = (color >> 24) / 255.0;
+    double g = ((color >> 16) & 0xFF) / 255.0;
+    double b = ((color >> 8) & 0xFF) / 255.0;
+    double y = kr * r + (1 - kr - kb) * g + kb * b;
+    double cb = (b - y) / (2 * (1 - kb));
+    double cr = (r - y) / (2 * (1 - kr));
+
+    int32_t max = (1 << bits) - 1, scale = 1 << (bits - 8);
+    double y_mul = full_range ? max : 219 * scale;
+    double c_mul = full_range ? max : 224 * scale;
+    double y_off = full_range ? 0 : 16 * scale;
+    double val[3] = {
+        y_off + y_mul * y, 128 * scale + c_mul * cb, 128 * scale + c_mul * cr
+    };
+    for (int i = 0; i < 3; i++)
+        yuv[i] = FFMINMAX(ass_lrint(val[i]), 0, max);
+}
+
+/**
+ * \brief Average 2x2 blocks of the part of an image within the given
+ * frame rectangle, pixels outside of it count as transparent.
+ * \param interleave store every value twice for interleaved chroma planes
+ * \return mask in priv->chroma_mask with the given stride, NULL on failure
+ */
+static const uint8_t *subsample_mask(ASS_Renderer *priv, const ASS_Image *img,
+                                     int x_min, int y_min, int x_max, int y_max,
+                                     bool interleave, ptrdiff_t *stride)
+{
+    int cx_min = x_min >> 1, cx_max = (x_max + 1) >> 1;
+    int cy_min = y_min >> 1, cy_max = (y_max + 1) >> 1;
+    int step = interleave ? 2 : 1;
+    *stride = (ptrdiff_t) step * (cx_max - cx_min);
+
+    size_t size = *stride * (cy_max - cy_min);
+    if (size > priv->chroma_mask_size) {
+        size_t new_size = FFMAX(size, 2 * priv->chroma_mask_size);
+        if (!ASS_REALLOC_ARRAY(priv->chroma_mask, new_size))
+            return NULL;
+        priv->chroma_mask_size = new_size;
+    }
+
+    uint8_t *dst = priv->chroma_mask;
+    for (int cy = cy_min; cy < cy_max; cy++) {
+        int y0 = FFMAX(2 * cy, y_min), y1 = FFMIN(2 * cy + 2, y_max);
+        for (int cx = cx_min; cx < cx_max; cx++) {
+            int x0 = FFMAX(2 * cx, x_min), x1 = FFMIN(2 * cx + 2, x_max);
+            unsigned sum = 0;
+            for (int y = y0; y < y1; y++) {
+                const uint8_t *src = img->bitmap +
+                    (ptrdiff_t) (y - img->dst_y) * img->stride;
+                for (int x = x0; x < x1; x++)
+                    sum += src[x - img->dst_x];
+            }
+            uint8_t *out = dst + step * (cx - cx_min);
+            out[0] = out[step - 1] = (sum + 2) >> 2;
+        }
+        dst += *stride;
+    }
+    return priv->chroma_mask;
+}
+
+int ass_blend_frame_yuv(ASS_Renderer *priv, ASS_Track *track,
+                        const ASS_Image *images, ASS_YUVFormat format,
+                        ASS_YCbCrMatrix video_matrix,
+                        unsigned char *const planes[3], const int strides[3],
+                        int width, int height)
+{
+    ASS_YCbCrMatrix matrix = select_yuv_matrix(track, video_matrix);
+    int bits = format == ASS_YUV_P010 ? 10 : 8;
+    int size = bits > 8 ? 2 : 1;
+    BlendPlaneFunc *blend = bits > 8 ?
+        priv->engine.blend_plane10 : priv->engine.blend_plane8;
+
+    for (const ASS_Image *img = images; img; img = img->next) {
+        int x_min = FFMAX(img->dst_x, 0);
+        int y_min = FFMAX(img->dst_y, 0);
+        int x_max = FFMIN(img->dst_x + img->w, width);
+        int y_max = FFMIN(img->dst_y + img->h, height);
+        uint32_t opacity = 255 - (img->color & 0xFF);
+        if (x_min >= x_max || y_min >= y_max || !opacity)
+            continue;
+
+        int32_t yuv[3];
+        rgb_to_yuv(img->color, matrix, bits, yuv);
+        opacity <<= 24;
+
+        const uint8_t *src = img->bitmap +
+            (ptrdiff_t) (y_min - img->dst_y) * img->stride + (x_min - img->dst_x);
+        uint8_t *dst = planes[0] + (ptrdiff_t) y_min * strides[0] + size * x_min;
+        blend(dst, strides[0], src, img->stride, x_max - x_min, y_max - y_min,
+              yuv[0] | yuv[0] << 12 | opacity);
+
+        bool interleave = format != ASS_YUV_I420;
+        ptrdiff_t mask_stride;
+        const uint8_t *mask = subsample_mask(priv, img, x_min, y_min, x_max, y_max,
+                                             interleave, &mask_stride);
+        if (!mask)
+            return 0;
+
+        int cx = x_min >> 1, cy = y_min >> 1;
+        int cw = ((x_max + 1) >> 1) - cx;
+        int ch = ((y_max + 1) >> 1) - cy;
+        if (interleave) {
+            dst = planes[1] + (ptrdiff_t) cy * strides[1] + 2 * size * cx;
+            blend(dst, strides[1], mask, mask_stride, 2 * cw, ch,
+                  yuv[1] | yuv[2] << 12 | opacity);
+            continue;
+        }
+        for (int i = 1; i < 3; i++) {
+            dst = planes[i] + (ptrdiff_t) cy * strides[i] + cx;
+            blend(dst, strides[i], mask, mask_stride, cw, ch,
+                  yuv[i] | yuv[i] << 12 | opacity);
+        }
+    }
+    return 1;
+}
@@ -30,21 +30,26 @@
 #include <hb.h>
 
 #include "ass.h"
+#include "ass_atlas.h"
 #include "ass_font.h"
 #include "ass_bitmap.h"
 #include "ass_cache.h"
+#include "ass_disk_cache.h"
 #include "ass_utils.h"
 #include "ass_fontselect.h"
 #include "ass_library.h"
 #include "ass_drawing.h"
 #include "ass_bitmap.h"
 #include "ass_rasterizer.h"
+#include "ass_threading.h"
 
 #define GLYPH_CACHE_MAX 10000
 #define MEGABYTE (1024 * 1024)
 #define BITMAP_CACHE_MAX_SIZE (128 * MEGABYTE)
 #define COMPOSITE_CACHE_RATIO 2
 #define COMPOSITE_CACHE_MAX_SIZE (BITMAP_CACHE_MAX_SIZE / COMPOSITE_CACHE_RATIO)
+#define MAX_RENDER_THREADS 64
+#define MAX_DIRTY_RECTS 64
 
 #define PARSED_FADE (1<<0)
 #define PARSED_A    (1<<1)
@@ -53,7 +58,9 @@ typedef struct {
     ASS_Image result;
     CompositeHashValue *source;
     unsigned char *buffer;
+    size_t *buffer_refs;        // owners of buffer once shared, NULL before
     size_t ref_count;
+    int run;                    // combined bitmap the image was rendered from, -1 if none
 } ASS_ImagePriv;
 
 typedef struct {
@@ -73,6 +80,8 @@ typedef struct {
     double par;                 // user defined pixel aspect ratio (0 = unset)
     ASS_Hinting hinting;
     ASS_ShapingLevel shaper;
+    ASS_TileSize tile_size;
+    int approximate_moves;      // shift composites of moving events instead of rasterizing them
     int selective_style_overrides; // ASS_OVERRIDE_* flags
 
     char *default_font;
@@ -85,9 +94,45 @@ typedef struct {
     int top, height, left, width;
     int detect_collisions;
     int shift_direction;
+    bool animated;              // depends on the time within the event
+    bool cached;                // copied from StaticEvent instead of rendered
+    struct color_map *colors;   // set if only colors are animated, owned
+    const struct static_event *recolor;    // images to reuse with new colors
     ASS_Event *event;
 } EventImages;
 
+// Identifies an event rendered in an earlier frame. Events are identified
+// by address; as that can be reused after pruning, the fields affecting
+// rendering are compared as well.
+typedef struct {
+    ASS_Track *track;
+    ASS_Event *event;
+    long long start, duration;
+    int read_order, layer, style;
+    int margin_l, margin_r, margin_v;
+    char *text;
+    double par_scale_x;
+} EventKey;
+
+// Where the images of an event animated only in color get their colors from.
+// Filter flags depend on transparency, so they have to match as well.
+typedef struct color_map {
+    int n_runs;                 // combined bitmaps
+    int *glyphs;                // glyph providing the colors of each one
+    int *flags;                 // its filter flags
+    int length;
+    bool *run_starts;           // style runs, before layout splits them further
+} ColorMap;
+
+// Images of an event without animation, reused while the event is displayed.
+// Events animated only in color are parsed every frame and recolored.
+typedef struct static_event {
+    EventKey key;
+    EventImages images;         // before collision handling
+    ColorMap *colors;           // NULL without animation
+    bool used;                  // displayed in the current frame
+} StaticEvent;
+
 typedef enum {
     EF_NONE = 0,
     EF_KARAOKE,
@@ -115,6 +160,7 @@ typedef struct {
     int x, y;
     Bitmap *bm, *bm_o, *bm_s;   // glyphs, outline, shadow bitmaps
     CompositeHashValue *image;
+    int glyph;                  // index of the glyph the colors come from
 } CombinedBitmapInfo;
 
 typedef struct {
@@ -203,6 +249,41 @@ typedef struct {
     unsigned max_bitmaps;
 } TextInfo;
 
+// Properties of a parsed glyph that shaping, wrapping and alignment depend on
+typedef struct {
+    unsigned symbol;
+    ASS_Font *font;
+    double font_size;
+    double scale_x, scale_y, scale_fix;
+    double border_x, border_y;
+    double hspacing;
+    int hspacing_scaled;
+    ASS_StringView drawing_text;
+    int drawing_scale;
+    int drawing_pbo;
+    unsigned bold, italic;
+    int flags;
+    bool starts_new_run;
+} GlyphLayoutKey;
+
+// Shaped, wrapped and aligned text of an animated event, reused in later
+// frames as long as the animation does not change any input of the layout.
+// Holds references to the fonts and outlines of its glyphs.
+typedef struct {
+    EventKey key;
+    int alignment, justify, evt_type, wrap_style, font_encoding;
+    double max_text_width;
+    GlyphLayoutKey *glyph_keys;
+    GlyphInfo *glyphs;          // cluster continuations are owned
+    FriBidiStrIndex *cmap;      // reorder map into visual order
+    int length;
+    LineInfo *lines;
+    int n_lines;
+    double height;
+    int border_top, border_bottom, border_x;
+    bool used;                  // displayed in the current frame
+} EventLayout;
+
 #include "ass_shaper.h"
 
 // Renderer state.
@@ -213,6 +294,13 @@ struct render_context {
     ASS_Shaper *shaper;
     RasterizerData rasterizer;
 
+    GlyphLayoutKey *layout_keys;    // of the current event before shaping
+    int max_layout_keys;
+    bool *run_starts;               // style runs of the current event before layout
+    int max_run_starts;
+    FriBidiStrIndex *cmap;          // reorder map of a restored layout
+    int max_cmap;
+
     ASS_Event *event;
     ASS_Style *style;
 
@@ -249,6 +337,9 @@ struct render_context {
     double shadow_x;
     double shadow_y;
     double pbo;                 // drawing baseline offset
+    bool animated;              // output depends on the frame time
+    bool animated_geometry;     // animation changes more than colors and position
+    bool animated_position;     // animation moves the event
     ASS_StringView clip_drawing_text;
 
     // used to store RenderContext.style when doing selective style overrides
@@ -297,6 +388,32 @@ struct render_context {
 
 typedef struct render_context RenderContext;
 
+typedef struct {
+    ASS_Thread thread;
+    RenderContext state;
+} RenderWorker;
+
+// Pool of additional threads rendering the events of a frame in parallel;
+// the thread calling ass_render_frame() takes part in rendering as well.
+typedef struct {
+    RenderWorker *workers;
+    int n_workers;
+
+    ASS_Mutex lock;             // protects all fields below
+    ASS_Cond start, done;
+    unsigned generation;        // incremented for every dispatched frame
+    int pending;                // number of workers still busy with the frame
+    int n_events, next_event;   // queue of events in ASS_Renderer.eimg
+    bool quit;
+
+    // jobs of a large outline, see ass_rasterizer_fill();
+    // idle threads help the thread that owns them
+    const RasterizerData *raster;   // owner of the jobs, NULL if none
+    size_t n_raster_jobs, next_raster_job, finished_raster_jobs;
+    bool raster_failed;
+    ASS_Cond raster_done;
+} RenderThreads;
+
 typedef struct {
     Cache *font_cache;
     Cache *outline_cache;
@@ -307,6 +424,9 @@ typedef struct {
     size_t glyph_max;
     size_t bitmap_max_size;
     size_t composite_max_size;
+    size_t budget;              // 0 if the limits above apply
+    DiskCache *disk_cache;      // NULL if disabled
+    long long lookahead;        // negative if timeline eviction is disabled
 } CacheStore;
 
 struct ass_renderer {
@@ -320,9 +440,24 @@ struct ass_renderer {
     ASS_Image *images_root;     // rendering result is stored here
     ASS_Image *prev_images_root;
 
+    ASS_DirtyRect dirty_rects[MAX_DIRTY_RECTS]; // changes between the two lists above
+    int n_dirty_rects;          // -1 until requested for the current frame
+    struct image_ref *image_refs; // temporary buffer for matching images
+    int max_image_refs;
+    uint8_t *chroma_mask;       // temporary buffer for ass_blend_frame_yuv()
+    size_t chroma_mask_size;
+    Atlas atlas;                // output of ass_render_frame_atlas()
+
     EventImages *eimg;          // temporary buffer for sorting rendered events
     int eimg_size;              // allocated buffer size
 
+    StaticEvent *static_events; // rendered events without animation
+    int n_static_events, max_static_events;
+
+    EventLayout *layouts;       // layouts of animated events
+    int n_layouts, max_layouts;
+    ASS_Mutex layout_lock;      // protects layouts while rendering
+
     // frame-global data
     int width, height;          // screen dimensions (the whole frame from ass_set_frame_size)
     int frame_content_height;   // content frame height ( = screen height - API margins )
@@ -336,6 +471,10 @@ struct ass_renderer {
     RenderContext state;
     CacheStore cache;
 
+    RenderThreads threads;
+    // serializes all access to FreeType, HarfBuzz and font selection
+    ASS_Mutex font_lock;
+
     BitmapEngine engine;
 
     ASS_Style user_override_style;
@@ -356,6 +495,8 @@ typedef struct {
 void ass_reset_render_context(RenderContext *state, ASS_Style *style);
 void ass_frame_ref(ASS_Image *img);
 void ass_frame_unref(ASS_Image *img);
+void ass_flush_static_events(ASS_Renderer *priv);
+void ass_flush_layouts(ASS_Renderer *priv);
 ASS_Vector ass_layout_res(ASS_Renderer *render_priv);
 
 // XXX: this is actually in ass.c, includes should be fixed later on
@@ -26,11 +26,20 @@
 #include "ass_render.h"
 #include "ass_utils.h"
 
+// Forget rendering results kept across frames, for settings
+// that do not affect anything cached per glyph
+static void flush_events(ASS_Renderer *priv)
+{
+    ass_flush_static_events(priv);
+    ass_flush_layouts(priv);
+}
+
 static void ass_reconfigure(ASS_Renderer *priv)
 {
     ASS_Settings *settings = &priv->settings;
 
     priv->render_id++;
+    flush_events(priv);
     ass_cache_empty(priv->cache.composite_cache);
     ass_cache_empty(priv->cache.bitmap_cache);
     ass_cache_empty(priv->cache.outline_cache);
@@ -79,10 +88,12 @@ void ass_set_storage_size(ASS_Renderer *priv, int w, int h)
 void ass_set_shaper(ASS_Renderer *priv, ASS_ShapingLevel level)
 {
     // select the complex shaper for illegal values
-    if (level == ASS_SHAPING_SIMPLE || level == ASS_SHAPING_COMPLEX)
+    if (level != ASS_SHAPING_SIMPLE && level != ASS_SHAPING_COMPLEX)
+        level = ASS_SHAPING_COMPLEX;
+    if (priv->settings.shaper != level) {
         priv->settings.shaper = level;
-    else
-        priv->settings.shaper = ASS_SHAPING_COMPLEX;
+        flush_events(priv);
+    }
 }
 
 void ass_set_margins(ASS_Renderer *priv, int t, int b, int l, int r)
@@ -99,7 +110,10 @@ void ass_set_margins(ASS_Renderer *priv, int t, int b, int l, int r)
 
 void ass_set_use_margins(ASS_Renderer *priv, int use)
 {
-    priv->settings.use_margins = use;
+    if (priv->settings.use_margins != use) {
+        priv->settings.use_margins = use;
+        flush_events(priv);
+    }
 }
 
 void ass_set_aspect_ratio(ASS_Renderer *priv, double dar, double sar)
@@ -132,9 +146,29 @@ void ass_set_hinting(ASS_Renderer *priv, ASS_Hinting ht)
     }
 }
 
+void ass_set_tile_size(ASS_Renderer *priv, ASS_TileSize tiles)
+{
+    if (priv->settings.tile_size != tiles) {
+        priv->settings.tile_size = tiles;
+        ass_reconfigure(priv);
+    }
+}
+
+void ass_set_approximate_moves(ASS_Renderer *priv, int approximate)
+{
+    approximate = !!approximate;
+    if (priv->settings.approximate_moves != approximate) {
+        priv->settings.approximate_moves = approximate;
+        ass_reconfigure(priv);
+    }
+}
+
 void ass_set_line_spacing(ASS_Renderer *priv, double line_spacing)
 {
-    priv->settings.line_spacing = line_spacing;
+    if (priv->settings.line_spacing != line_spacing) {
+        priv->settings.line_spacing = line_spacing;
+        flush_events(priv);
+    }
 }
 
 void ass_set_line_position(ASS_Renderer *priv, double line_position)
@@ -207,6 +241,63 @@ void ass_set_cache_limits(ASS_Renderer *render_priv, int glyph_max,
     render_priv->cache.composite_max_size = composite_cache;
 }
 
+void ass_set_cache_policy(ASS_Renderer *render_priv, ASS_CachePolicy policy)
+{
+    if (policy != ASS_CACHE_POLICY_SLRU)
+        policy = ASS_CACHE_POLICY_LRU;
+    CacheStore *cache = &render_priv->cache;
+    ass_cache_set_policy(cache->composite_cache, policy);
+    ass_cache_set_policy(cache->bitmap_cache, policy);
+    ass_cache_set_policy(cache->outline_cache, policy);
+}
+
+void ass_set_cache_lookahead(ASS_Renderer *render_priv, long long lookahead)
+{
+    render_priv->cache.lookahead = lookahead < 0 ? -1 : lookahead;
+}
+
+void ass_get_cache_stats(ASS_Renderer *render_priv, ASS_CacheStats *stats)
+{
+    CacheStore *cache = &render_priv->cache;
+    ass_cache_get_stats(cache->font_cache, &stats->font);
+    ass_cache_get_stats(cache->outline_cache, &stats->outline);
+    ass_cache_get_stats(cache->metrics_cache, &stats->glyph_metrics);
+    ass_cache_get_stats(cache->face_size_metrics_cache, &stats->face_size_metrics);
+    ass_cache_get_stats(cache->bitmap_cache, &stats->bitmap);
+    ass_cache_get_stats(cache->composite_cache, &stats->composite);
+}
+
+void ass_set_cache_budget(ASS_Renderer *render_priv, size_t max_bytes)
+{
+    render_priv->cache.budget = max_bytes;
+}
+
+int ass_set_disk_cache(ASS_Renderer *render_priv, const char *path)
+{
+    CacheStore *cache = &render_priv->cache;
+    bool ok = true;
+    if (cache->disk_cache) {
+        ok = ass_disk_cache_save(cache->disk_cache);
+        ass_disk_cache_close(cache->disk_cache);
+        cache->disk_cache = NULL;
+    }
+    if (path) {
+        cache->disk_cache = ass_disk_cache_open(render_priv->library,
+                                                render_priv->ftlibrary, path);
+        ok = ok && cache->disk_cache;
+    }
+    return ok;
+}
+
+size_t ass_get_cache_size(ASS_Renderer *render_priv)
+{
+    ASS_CacheStats stats;
+    ass_get_cache_stats(render_priv, &stats);
+    return stats.font.bytes + stats.outline.bytes +
+        stats.glyph_metrics.bytes + stats.face_size_metrics.bytes +
+        stats.bitmap.bytes + stats.composite.bytes;
+}
+
 ASS_FontProvider *
 ass_create_font_provider(ASS_Renderer *priv, ASS_FontProviderFuncs *funcs,
                          void *data)
@@ -226,8 +226,8 @@ get_cached_metrics(struct ass_shaper_metrics_data *metrics,
         .size = metrics->hash_key.size,
         .glyph_index = glyph,
     };
-    FT_Glyph_Metrics *val = ass_cache_get(metrics->metrics_cache, &key,
-                                          rotate ? metrics : NULL);
+    FT_Glyph_Metrics *val = ass_cache_get_glyph_metrics(metrics->metrics_cache, &key,
+                                                        rotate ? metrics : NULL);
     if (!val || val->width < 0)
         return NULL;
 
@@ -471,7 +471,7 @@ static hb_font_t *get_hb_font(ASS_Shaper *shaper, GlyphInfo *info)
         .face_index = info->face_index,
         .size = info->font_size,
     };
-    FT_Size_Metrics *m = ass_cache_get(shaper->face_size_metrics_cache, &key, NULL);
+    FT_Size_Metrics *m = ass_cache_get_face_size_metrics(shaper->face_size_metrics_cache, &key, NULL);
     if (!m)
         return NULL;
 
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdlib.h>
+
+#include "ass_threading.h"
+
+#if CONFIG_THREADS
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef struct {
+    ASS_ThreadFunc func;
+    void *arg;
+} ThreadStart;
+
+#ifdef _WIN32
+static unsigned __stdcall thread_entry(void *p)
+#else
+static void *thread_entry(void *p)
+#endif
+{
+    ThreadStart start = *(ThreadStart *) p;
+    free(p);
+    start.func(start.arg);
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+bool ass_thread_create(ASS_Thread *thread, ASS_ThreadFunc func, void *arg)
+{
+    ThreadStart *start = malloc(sizeof(*start));
+    if (!start)
+        return false;
+    start->func = func;
+    start->arg = arg;
+
+#ifdef _WIN32
+    uintptr_t handle = _beginthreadex(NULL, 0, thread_entry, start, 0, NULL);
+    if (handle) {
+        *thread = (HANDLE) handle;
+        return true;
+    }
+#else
+    if (!pthread_create(thread, NULL, thread_entry, start))
+        return true;
+#endif
+
+    free(start);
+    return false;
+}
+
+void ass_thread_join(ASS_Thread thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+int ass_get_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    int count = 1;
+#endif
+    return count > 0 ? count : 1;
+}
+
+#else
+
+bool ass_thread_create(ASS_Thread *thread, ASS_ThreadFunc func, void *arg)
+{
+    return false;
+}
+
+void ass_thread_join(ASS_Thread thread)
+{
+}
+
+int ass_get_cpu_count(void)
+{
+    return 1;
+}
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_THREADING_H
+#define LIBASS_THREADING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Thin wrappers over the native threading primitives.
+// Without CONFIG_THREADS all locking is a no-op and thread creation fails,
+// so callers transparently fall back to single-threaded operation.
+
+#if CONFIG_THREADS && defined(_WIN32)
+
+#include <windows.h>
+
+typedef SRWLOCK ASS_Mutex;
+typedef CONDITION_VARIABLE ASS_Cond;
+typedef HANDLE ASS_Thread;
+
+static inline bool ass_mutex_init(ASS_Mutex *mutex)
+{
+    InitializeSRWLock(mutex);
+    return true;
+}
+
+static inline void ass_mutex_destroy(ASS_Mutex *mutex)
+{
+}
+
+static inline void ass_mutex_lock(ASS_Mutex *mutex)
+{
+    AcquireSRWLockExclusive(mutex);
+}
+
+static inline void ass_mutex_unlock(ASS_Mutex *mutex)
+{
+    ReleaseSRWLockExclusive(mutex);
+}
+
+static inline bool ass_cond_init(ASS_Cond *cond)
+{
+    InitializeConditionVariable(cond);
+    return true;
+}
+
+static inline void ass_cond_destroy(ASS_Cond *cond)
+{
+}
+
+static inline void ass_cond_wait(ASS_Cond *cond, ASS_Mutex *mutex)
+{
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+static inline void ass_cond_signal(ASS_Cond *cond)
+{
+    WakeConditionVariable(cond);
+}
+
+static inline void ass_cond_broadcast(ASS_Cond *cond)
+{
+    WakeAllConditionVariable(cond);
+}
+
+#elif CONFIG_THREADS
+
+#include <pthread.h>
+
+typedef pthread_mutex_t ASS_Mutex;
+typedef pthread_cond_t ASS_Cond;
+typedef pthread_t ASS_Thread;
+
+static inline bool ass_mutex_init(ASS_Mutex *mutex)
+{
+    return !pthread_mutex_init(mutex, NULL);
+}
+
+static inline void ass_mutex_destroy(ASS_Mutex *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+static inline void ass_mutex_lock(ASS_Mutex *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static inline void ass_mutex_unlock(ASS_Mutex *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+static inline bool ass_cond_init(ASS_Cond *cond)
+{
+    return !pthread_cond_init(cond, NULL);
+}
+
+static inline void ass_cond_destroy(ASS_Cond *cond)
+{
+    pthread_cond_destroy(cond);
+}
+
+static inline void ass_cond_wait(ASS_Cond *cond, ASS_Mutex *mutex)
+{
+    pthread_cond_wait(cond, mutex);
+}
+
+static inline void ass_cond_signal(ASS_Cond *cond)
+{
+    pthread_cond_signal(cond);
+}
+
+static inline void ass_cond_broadcast(ASS_Cond *cond)
+{
+    pthread_cond_broadcast(cond);
+}
+
+#else
+
+typedef char ASS_Mutex;
+typedef char ASS_Cond;
+typedef char ASS_Thread;
+
+static inline bool ass_mutex_init(ASS_Mutex *mutex)
+{
+    return true;
+}
+
+static inline void ass_mutex_destroy(ASS_Mutex *mutex)
+{
+}
+
+static inline void ass_mutex_lock(ASS_Mutex *mutex)
+{
+}
+
+static inline void ass_mutex_unlock(ASS_Mutex *mutex)
+{
+}
+
+static inline bool ass_cond_init(ASS_Cond *cond)
+{
+    return true;
+}
+
+static inline void ass_cond_destroy(ASS_Cond *cond)
+{
+}
+
+static inline void ass_cond_wait(ASS_Cond *cond, ASS_Mutex *mutex)
+{
+}
+
+static inline void ass_cond_signal(ASS_Cond *cond)
+{
+}
+
+static inline void ass_cond_broadcast(ASS_Cond *cond)
+{
+}
+
+#endif
+
+// Atomic operations on size_t, used for reference counting.
+// All of them are sequentially consistent; add and sub return the new value.
+
+#if CONFIG_THREADS && defined(_MSC_VER)
+
+#include <intrin.h>
+
+#ifdef _WIN64
+#define ASS_XADD(ptr, val) _InterlockedExchangeAdd64((volatile __int64 *) (ptr), (val))
+#define ASS_CMPXCHG(ptr, desired, expected) \
+    _InterlockedCompareExchange64((volatile __int64 *) (ptr), (desired), (expected))
+#else
+#define ASS_XADD(ptr, val) _InterlockedExchangeAdd((volatile long *) (ptr), (val))
+#define ASS_CMPXCHG(ptr, desired, expected) \
+    _InterlockedCompareExchange((volatile long *) (ptr), (desired), (expected))
+#endif
+
+static inline size_t ass_atomic_load(size_t *ptr)
+{
+    return (size_t) ASS_CMPXCHG(ptr, 0, 0);
+}
+
+static inline size_t ass_atomic_add(size_t *ptr, size_t val)
+{
+    return (size_t) ASS_XADD(ptr, val) + val;
+}
+
+static inline size_t ass_atomic_sub(size_t *ptr, size_t val)
+{
+    return (size_t) ASS_XADD(ptr, -val) - val;
+}
+
+static inline bool ass_atomic_cas(size_t *ptr, size_t *expected, size_t desired)
+{
+    size_t prev = (size_t) ASS_CMPXCHG(ptr, desired, *expected);
+    if (prev == *expected)
+        return true;
+    *expected = prev;
+    return false;
+}
+
+#undef ASS_XADD
+#undef ASS_CMPXCHG
+
+#elif CONFIG_THREADS
+
+static inline size_t ass_atomic_load(size_t *ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline size_t ass_atomic_add(size_t *ptr, size_t val)
+{
+    return __atomic_add_fetch(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline size_t ass_atomic_sub(size_t *ptr, size_t val)
+{
+    return __atomic_sub_fetch(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline bool ass_atomic_cas(size_t *ptr, size_t *expected, size_t desired)
+{
+    return __atomic_compare_exchange_n(ptr, expected, desired, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#else
+
+static inline size_t ass_atomic_load(size_t *ptr)
+{
+    return *ptr;
+}
+
+static inline size_t ass_atomic_add(size_t *ptr, size_t val)
+{
+    return *ptr += val;
+}
+
+static inline size_t ass_atomic_sub(size_t *ptr, size_t val)
+{
+    return *ptr -= val;
+}
+
+static inline bool ass_atomic_cas(size_t *ptr, size_t *expected, size_t desired)
+{
+    if (*ptr != *expected) {
+        *expected = *ptr;
+        return false;
+    }
+    *ptr = desired;
+    return true;
+}
+
+#endif
+
+typedef void (*ASS_ThreadFunc)(void *arg);
+
+bool ass_thread_create(ASS_Thread *thread, ASS_ThreadFunc func, void *arg);
+void ass_thread_join(ASS_Thread thread);
+int ass_get_cpu_count(void);
+
+#endif /* LIBASS_THREADING_H */
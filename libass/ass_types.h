@@ -54,10 +54,11 @@
  *      unless the documentation of the function says otherwise.
  *    - After manual changes have been performed, no track-modifying API may be
  *      invoked, except for ass_track_set_feature and ass_flush_events.
- *  - After the first call to ass_render_frame, existing array members
- *    (e.g. members of events) and non-array track fields (e.g. PlayResX
- *    or event_format) must not be modified. Adding new members to arrays
- *    and updating the corresponding counter remains allowed.
+ *  - After the first call to ass_render_frame, ass_step_sub or
+ *    ass_next_event_change, existing array members (e.g. members of events)
+ *    and non-array track fields (e.g. PlayResX or event_format) must not be
+ *    modified. Adding new members to arrays and updating the corresponding
+ *    counter remains allowed.
  *  - Adding and removing members to array fields, like events or styles,
  *    must be done through the corresponding API function, e.g. ass_alloc_event.
  *    See the documentation of these functions.
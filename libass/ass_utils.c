@@ -24,6 +24,11 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #include "ass_library.h"
 #include "ass.h"
@@ -79,6 +84,27 @@ void ass_aligned_free(void *ptr)
         free(*((void **)ptr - 1));
 }
 
+/**
+ * Monotonic time in nanoseconds since an unspecified point,
+ * meant for measuring durations only.
+ */
+int64_t ass_time_ns(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, freq;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&freq);
+    return (int64_t) ((double) counter.QuadPart * 1e9 / freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+        return ts.tv_sec * (int64_t) 1000000000 + ts.tv_nsec;
+    return 0;
+#else
+    return (int64_t) ((double) clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
 /**
  * This works similar to realloc(ptr, nmemb * size), but checks for overflow.
  *
@@ -89,6 +89,7 @@ static inline bool ass_string_equal(ASS_StringView str1, ASS_StringView str2)
 
 void *ass_aligned_alloc(size_t alignment, size_t size, bool zero);
 void ass_aligned_free(void *ptr);
+int64_t ass_time_ns(void);
 
 void *ass_realloc_array(void *ptr, size_t nmemb, size_t size);
 void *ass_try_realloc_array(void *ptr, size_t nmemb, size_t size);
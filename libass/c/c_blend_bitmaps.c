@@ -88,3 +88,124 @@ void ass_mul_bitmaps_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
         src2 += src2_stride;
     }
 }
+
+/**
+ * \brief Blend a color with an alpha mask over premultiplied pixels
+ * Color holds the channels in memory order in the lower bytes
+ * and the opacity in the highest byte.
+ */
+void ass_blend_rgba_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                      const uint8_t *restrict src, ptrdiff_t src_stride,
+                      size_t width, size_t height, uint32_t color)
+{
+    ASSUME(width > 0 && height > 0);
+
+    int32_t col[4] = {
+        color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF, 255
+    };
+    uint32_t opacity = color >> 24;
+    opacity += opacity >> 7;  // [0, 256]
+
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (size_t x = 0; x < width; x++) {
+            int32_t a = (src[x] * opacity) >> 8;
+            a += a >> 7;
+            uint8_t *pix = dst + 4 * x;
+            for (int i = 0; i < 4; i++)
+                pix[i] = (pix[i] * 256 + (col[i] - pix[i]) * a) >> 8;
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+/**
+ * \brief Same as ass_blend_rgba_c() for pixels with straight alpha
+ */
+void ass_blend_rgba_straight_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                               const uint8_t *restrict src, ptrdiff_t src_stride,
+                               size_t width, size_t height, uint32_t color)
+{
+    ASSUME(width > 0 && height > 0);
+
+    uint32_t col[3] = {
+        color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF
+    };
+    uint32_t opacity = color >> 24;
+    opacity += opacity >> 7;
+
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (size_t x = 0; x < width; x++) {
+            uint32_t a = (src[x] * opacity) >> 8;
+            a += a >> 7;
+            if (!a)
+                continue;
+            uint8_t *pix = dst + 4 * x;
+            // weights are in units of 1/256 like a
+            uint32_t w = (pix[3] * (256 - a) + 127) / 255;
+            uint32_t sum = a + w;
+            for (int i = 0; i < 3; i++)
+                pix[i] = (col[i] * a + pix[i] * w + sum / 2) / sum;
+            pix[3] = (sum * 255 + 128) >> 8;
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+/**
+ * \brief Blend a color with an alpha mask over a plane of 8-bit samples
+ * Even and odd samples get the values in bits 0-11 and 12-23 of color,
+ * the opacity is in the highest byte.
+ */
+void ass_blend_plane8_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                        const uint8_t *restrict src, ptrdiff_t src_stride,
+                        size_t width, size_t height, uint32_t color)
+{
+    ASSUME(width > 0 && height > 0);
+
+    int32_t val[2] = { color & 0xFFF, (color >> 12) & 0xFFF };
+    uint32_t opacity = color >> 24;
+    opacity += opacity >> 7;
+
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (size_t x = 0; x < width; x++) {
+            int32_t a = (src[x] * opacity) >> 8;
+            a += a >> 7;
+            dst[x] = (dst[x] * 256 + (val[x & 1] - dst[x]) * a) >> 8;
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+/**
+ * \brief Same as ass_blend_plane8_c() for 10-bit values
+ * stored in the highest bits of 16-bit samples
+ */
+void ass_blend_plane10_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                         const uint8_t *restrict src, ptrdiff_t src_stride,
+                         size_t width, size_t height, uint32_t color)
+{
+    ASSUME(width > 0 && height > 0);
+
+    int32_t val[2] = { color & 0xFFF, (color >> 12) & 0xFFF };
+    uint32_t opacity = color >> 24;
+    opacity += opacity >> 7;
+
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        uint16_t *pix = (uint16_t *) dst;
+        for (size_t x = 0; x < width; x++) {
+            int32_t a = (src[x] * opacity) >> 8;
+            a += a >> 7;
+            int32_t d = pix[x] >> 6;
+            pix[x] = ((d * 256 + (val[x & 1] - d) * a) >> 8) << 6;
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
@@ -25,9 +25,11 @@
 #include <memory.h>
 
 
-static int16_t zero_line[16];
-static int16_t dither_line[32] = {
+static int16_t zero_line[32];
+static int16_t dither_line[64] = {
      8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,
+     8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,  8, 40,
+    56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24,
     56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24, 56, 24,
 };
 
@@ -73,3 +75,9 @@ static inline void expand_func(int16_t *rp, int16_t *rn,
 #include "blur_template.h"
 #undef ALIGNMENT
 #undef SUFFIX
+
+#define ALIGNMENT     64
+#define SUFFIX(name)  name ## 64_c
+#include "blur_template.h"
+#undef ALIGNMENT
+#undef SUFFIX
@@ -1,5 +1,5 @@
 ;******************************************************************************
-;* blend_bitmaps.asm: SSE2 and AVX2 bitmap blending
+;* blend_bitmaps.asm: SSE2, AVX2 and AVX-512 bitmap blending
 ;******************************************************************************
 ;* Copyright (C) 2013 rcombs <rcombs@rcombs.me>
 ;*
@@ -20,19 +20,19 @@
 
 %include "x86/utils.asm"
 
-SECTION_RODATA 32
+SECTION_RODATA 64
 
 %if ARCH_X86_64 || !PIC
-times 32 db 0xFF
-edge_mask: times 32 db 0x00
-words_255: times 16 dw 0xFF
+times 64 db 0xFF
+edge_mask: times 64 db 0x00
+words_255: times 32 dw 0xFF
 %endif
 
 SECTION .text
 
 ;------------------------------------------------------------------------------
 ; LOAD_EDGE_MASK 1:m_dst, 2:n, 3:tmp
-; Set n last bytes of xmm/ymm register to zero and other bytes to 255
+; Set n last bytes of xmm/ymm/zmm register to zero and other bytes to 255
 ;------------------------------------------------------------------------------
 
 %macro LOAD_EDGE_MASK 3
@@ -111,6 +111,10 @@ INIT_XMM sse2
 ADD_BITMAPS
 INIT_YMM avx2
 ADD_BITMAPS
+%if ARCH_X86_64
+INIT_ZMM avx512
+ADD_BITMAPS
+%endif
 
 ;------------------------------------------------------------------------------
 ; IMUL_BITMAPS
@@ -140,7 +144,11 @@ cglobal imul_bitmaps, 5,7,8
     BCASTD 5, t0d
 %endif
     pxor m6, m6
+%if mmsize == 64
+    vpternlogd m7, m7, m7, 0xFF
+%else
     pcmpeqb m7, m7
+%endif
 %if !ARCH_X86_64
     mov r5, r5m
 %endif
@@ -194,6 +202,10 @@ INIT_XMM sse2
 IMUL_BITMAPS
 INIT_YMM avx2
 IMUL_BITMAPS
+%if ARCH_X86_64
+INIT_ZMM avx512
+IMUL_BITMAPS
+%endif
 
 ;------------------------------------------------------------------------------
 ; MUL_BITMAPS
@@ -273,3 +285,318 @@ INIT_XMM sse2
 MUL_BITMAPS
 INIT_YMM avx2
 MUL_BITMAPS
+%if ARCH_X86_64
+INIT_ZMM avx512
+MUL_BITMAPS
+%endif
+
+;------------------------------------------------------------------------------
+; BLEND_PIXELS 1:m_mask, 2:m_dst, 3:m_tmp, 4:m_opacity, 5:m_color
+; Blend color over words of destination with words of mask,
+; result is stored in m_mask
+;------------------------------------------------------------------------------
+
+%macro BLEND_PIXELS 5
+    pmullw %1, %4
+    psrlw %1, 8
+    psrlw %3, %1, 7
+    paddw %1, %3
+    psubw %3, %5, %2
+    pmullw %1, %3
+    psllw %2, 8
+    paddw %1, %2
+    psrlw %1, 8
+%endmacro
+
+;------------------------------------------------------------------------------
+; BLEND_RGBA
+; void blend_rgba(uint8_t *dst, ptrdiff_t dst_stride,
+;                 const uint8_t *src, ptrdiff_t src_stride,
+;                 size_t width, size_t height, uint32_t color);
+;------------------------------------------------------------------------------
+
+%macro BLEND_RGBA 0
+%if ARCH_X86_64
+cglobal blend_rgba, 7,8,8
+    DECLARE_REG_TMP 7
+%else
+cglobal blend_rgba, 7,7,8
+    DECLARE_REG_TMP 1
+%endif
+    pxor m7, m7
+    mov t0d, r6d
+    or t0d, 0xFF000000
+    BCASTD 6, t0d
+    punpcklbw m6, m7
+    shr r6d, 24
+    mov t0d, r6d
+    shr t0d, 7
+    add r6d, t0d
+    BCASTW 5, r6d
+
+.row_loop:
+    xor r6d, r6d
+    jmp .width_check
+
+.width_loop:
+%if mmsize == 32
+    movq xm0, [r2 + r6]
+    punpcklbw xm0, xm0
+    vpermq m0, m0, q1100
+%else
+    movd m0, [r2 + r6]
+    punpcklbw m0, m0
+%endif
+    punpcklwd m0, m0
+    movu m1, [r0 + 4 * r6]
+    punpcklbw m2, m0, m7
+    punpcklbw m3, m1, m7
+    BLEND_PIXELS m2, m3, m4, m5, m6
+    punpckhbw m0, m7
+    punpckhbw m1, m7
+    BLEND_PIXELS m0, m1, m4, m5, m6
+    packuswb m2, m0
+    movu [r0 + 4 * r6], m2
+    add r6, mmsize / 4
+.width_check:
+    lea t0, [r6 + mmsize / 4]
+    cmp t0, r4
+    jbe .width_loop
+    cmp r6, r4
+    jae .next_row
+
+.tail_loop:
+    movzx t0d, byte [r2 + r6]
+    imul t0d, 0x01010101
+    movd xm0, t0d
+    movd xm1, [r0 + 4 * r6]
+    punpcklbw xm0, xm7
+    punpcklbw xm1, xm7
+    BLEND_PIXELS xm0, xm1, xm4, xm5, xm6
+    packuswb xm0, xm0
+    movd [r0 + 4 * r6], xm0
+    inc r6
+    cmp r6, r4
+    jb .tail_loop
+
+.next_row:
+%if ARCH_X86_64
+    add r0, r1
+    add r2, r3
+%else
+    add r0, r1m
+    add r2, r3m
+%endif
+    dec r5
+    jnz .row_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+BLEND_RGBA
+INIT_YMM avx2
+BLEND_RGBA
+
+;------------------------------------------------------------------------------
+; LOAD_PLANE_COLOR
+; Load opacity into words of m5 and alternating even and odd values
+; from the lower bits of r6d into words of m6, t0 is clobbered
+;------------------------------------------------------------------------------
+
+%macro LOAD_PLANE_COLOR 0
+    mov t0d, r6d
+    shr t0d, 24
+    cmp t0d, 128
+    sbb t0d, -1
+    BCASTW 5, t0d
+    mov t0d, r6d
+    shl t0d, 4
+    and t0d, 0x0FFF0000
+    and r6d, 0xFFF
+    or t0d, r6d
+    BCASTD 6, t0d
+%endmacro
+
+;------------------------------------------------------------------------------
+; SELECT_PLANE_COLOR 1:m_dst
+; Load value for sample r6 into the lowest word of m_dst
+;------------------------------------------------------------------------------
+
+%macro SELECT_PLANE_COLOR 1
+    pshuflw %1, xm6, q0000
+    test r6d, 1
+    jz %%even
+    pshuflw %1, xm6, q1111
+%%even:
+%endmacro
+
+;------------------------------------------------------------------------------
+; BLEND_PLANE8
+; void blend_plane8(uint8_t *dst, ptrdiff_t dst_stride,
+;                   const uint8_t *src, ptrdiff_t src_stride,
+;                   size_t width, size_t height, uint32_t color);
+;------------------------------------------------------------------------------
+
+%macro BLEND_PLANE8 0
+%if ARCH_X86_64
+cglobal blend_plane8, 7,8,8
+    DECLARE_REG_TMP 7
+%else
+cglobal blend_plane8, 7,7,8
+    DECLARE_REG_TMP 1
+%endif
+    pxor m7, m7
+    LOAD_PLANE_COLOR
+
+.row_loop:
+    xor r6d, r6d
+    jmp .width_check
+
+.width_loop:
+    movu m0, [r2 + r6]
+    movu m1, [r0 + r6]
+    punpcklbw m2, m0, m7
+    punpcklbw m3, m1, m7
+    BLEND_PIXELS m2, m3, m4, m5, m6
+    punpckhbw m0, m7
+    punpckhbw m1, m7
+    BLEND_PIXELS m0, m1, m4, m5, m6
+    packuswb m2, m0
+    movu [r0 + r6], m2
+    add r6, mmsize
+.width_check:
+    lea t0, [r6 + mmsize]
+    cmp t0, r4
+    jbe .width_loop
+    cmp r6, r4
+    jae .next_row
+
+.tail_loop:
+    movzx t0d, byte [r2 + r6]
+    movd xm0, t0d
+    movzx t0d, byte [r0 + r6]
+    movd xm1, t0d
+    SELECT_PLANE_COLOR xm3
+    BLEND_PIXELS xm0, xm1, xm2, xm5, xm3
+    movd t0d, xm0
+    mov [r0 + r6], t0b
+    inc r6
+    cmp r6, r4
+    jb .tail_loop
+
+.next_row:
+%if ARCH_X86_64
+    add r0, r1
+    add r2, r3
+%else
+    add r0, r1m
+    add r2, r3m
+%endif
+    dec r5
+    jnz .row_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+BLEND_PLANE8
+INIT_YMM avx2
+BLEND_PLANE8
+
+;------------------------------------------------------------------------------
+; BLEND_PLANE10
+; void blend_plane10(uint8_t *dst, ptrdiff_t dst_stride,
+;                    const uint8_t *src, ptrdiff_t src_stride,
+;                    size_t width, size_t height, uint32_t color);
+;------------------------------------------------------------------------------
+
+%macro BLEND_PLANE10 0
+%if ARCH_X86_64
+cglobal blend_plane10, 7,8,8
+    DECLARE_REG_TMP 7
+%else
+cglobal blend_plane10, 7,7,8
+    DECLARE_REG_TMP 1
+%endif
+    pxor m7, m7
+    LOAD_PLANE_COLOR
+    mov t0d, 256
+    BCASTW 4, t0d
+
+.row_loop:
+    xor r6d, r6d
+    jmp .width_check
+
+.width_loop:
+%if mmsize == 32
+    pmovzxbw m0, [r2 + r6]
+%else
+    movq m0, [r2 + r6]
+    punpcklbw m0, m7
+%endif
+    pmullw m0, m5
+    psrlw m0, 8
+    psrlw m1, m0, 7
+    paddw m0, m1
+    movu m1, [r0 + 2 * r6]
+    psrlw m1, 6
+    ; (d * 256 + (c - d) * a) as dot products of word pairs
+    psubw m3, m6, m1
+    punpckhwd m2, m3, m1
+    punpcklwd m3, m1
+    punpckhwd m1, m0, m4
+    punpcklwd m0, m4
+    pmaddwd m3, m0
+    pmaddwd m2, m1
+    psrld m3, 8
+    psrld m2, 8
+    packssdw m3, m2
+    psllw m3, 6
+    movu [r0 + 2 * r6], m3
+    add r6, mmsize / 2
+.width_check:
+    lea t0, [r6 + mmsize / 2]
+    cmp t0, r4
+    jbe .width_loop
+    cmp r6, r4
+    jae .next_row
+
+.tail_loop:
+    movzx t0d, byte [r2 + r6]
+    movd xm0, t0d
+    movzx t0d, word [r0 + 2 * r6]
+    movd xm1, t0d
+    pmullw xm0, xm5
+    psrlw xm0, 8
+    psrlw xm2, xm0, 7
+    paddw xm0, xm2
+    psrlw xm1, 6
+    SELECT_PLANE_COLOR xm3
+    psubw xm3, xm1
+    punpcklwd xm3, xm1
+    punpcklwd xm0, xm4
+    pmaddwd xm3, xm0
+    psrld xm3, 8
+    pslld xm3, 6
+    movd t0d, xm3
+    mov [r0 + 2 * r6], t0w
+    inc r6
+    cmp r6, r4
+    jb .tail_loop
+
+.next_row:
+%if ARCH_X86_64
+    add r0, r1
+    add r2, r3
+%else
+    add r0, r1m
+    add r2, r3m
+%endif
+    dec r5
+    jnz .row_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+BLEND_PLANE10
+INIT_YMM avx2
+BLEND_PLANE10
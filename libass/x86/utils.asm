@@ -106,7 +106,7 @@
 %ifnidn %1, %3
     mova %1, %3
 %endif
-%elif mmsize == 32
+%elif mmsize >= 32
     palignr %1, %2, %3, %5
 %elif cpuflag(ssse3)
 
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "unittest.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass_atlas.h"
+#include "ass_render.h"
+
+#define N_BITMAPS 48
+#define MAX_BITMAP_SIZE 40
+#define MIN_WIDTH 128
+#define MAX_IMAGES 64
+
+typedef struct {
+    unsigned char *data;
+    int w, h, stride;
+} TestBitmap;
+
+static bool init_bitmap(TestBitmap *bm, int w, int h)
+{
+    bm->w = w;
+    bm->h = h;
+    bm->stride = w + rnd() % 8;
+    bm->data = malloc((size_t) bm->stride * h);
+    if (!bm->data)
+        return unittest_fail("out of memory");
+    for (int i = 0; i < bm->stride * h; i++)
+        bm->data[i] = rnd();
+    return true;
+}
+
+/**
+ * \brief Build an image list showing the given bitmaps, like one returned
+ * by ass_render_frame() but without owning any bitmap
+ */
+static ASS_Image *make_images(const TestBitmap *bitmaps, const int *ids, int n)
+{
+    ASS_Image *head = NULL;
+    ASS_Image **tail = &head;
+    for (int i = 0; i < n; i++) {
+        ASS_ImagePriv *img = calloc(1, sizeof(ASS_ImagePriv));
+        if (!img) {
+            unittest_fail("out of memory");
+            break;
+        }
+        const TestBitmap *bm = bitmaps + ids[i];
+        img->result.w = bm->w;
+        img->result.h = bm->h;
+        img->result.stride = bm->stride;
+        img->result.bitmap = bm->data;
+        img->result.color = rnd();
+        img->result.dst_x = rnd() % 640;
+        img->result.dst_y = rnd() % 480;
+        img->result.type = rnd() % 3;
+        img->run = -1;
+        *tail = &img->result;
+        tail = &img->result.next;
+    }
+    ass_frame_ref(head);
+    return head;
+}
+
+static bool same_key(const ASS_Image *a, const ASS_Image *b)
+{
+    return a->bitmap == b->bitmap && a->w == b->w &&
+           a->h == b->h && a->stride == b->stride;
+}
+
+static bool in_atlas(const ASS_Atlas *out, int x, int y, int w, int h)
+{
+    return x >= 0 && y >= 0 && w >= 0 && h >= 0 &&
+           x <= out->w - w && y <= out->h - h;
+}
+
+/**
+ * \brief Check the rectangles and contents of the atlas for an image list
+ */
+static bool check_atlas(const Atlas *atlas, const ASS_Image *images,
+                        int min_width, const char *step)
+{
+    const ASS_Atlas *out = &atlas->out;
+    if (out->w < min_width || out->stride < out->w)
+        return unittest_fail("%s: atlas of %dx%d with stride %d is too narrow",
+                             step, out->w, out->h, out->stride);
+    for (int i = 0; i < out->n_updated; i++) {
+        const ASS_DirtyRect *r = out->updated + i;
+        if (!in_atlas(out, r->x, r->y, r->w, r->h))
+            return unittest_fail("%s: updated rectangle %d is out of bounds",
+                                 step, i);
+    }
+
+    int n = 0;
+    for (const ASS_Image *img = images; img; img = img->next, n++) {
+        if (n >= out->n_rects)
+            return unittest_fail("%s: only %d rectangles", step, out->n_rects);
+        const ASS_AtlasRect *rect = out->rects + n;
+        if (rect->w != img->w || rect->h != img->h ||
+                rect->dst_x != img->dst_x || rect->dst_y != img->dst_y ||
+                rect->color != img->color || rect->type != img->type)
+            return unittest_fail("%s: rectangle %d does not match its image",
+                                 step, n);
+        if (!in_atlas(out, rect->atlas_x, rect->atlas_y, rect->w, rect->h))
+            return unittest_fail("%s: rectangle %d is out of bounds", step, n);
+        const unsigned char *src = img->bitmap;
+        const unsigned char *dst = out->buffer +
+            (ptrdiff_t) rect->atlas_y * out->stride + rect->atlas_x;
+        for (int y = 0; y < img->h; y++)
+            if (memcmp(dst + (ptrdiff_t) y * out->stride,
+                       src + (ptrdiff_t) y * img->stride, img->w))
+                return unittest_fail("%s: wrong contents of rectangle %d",
+                                     step, n);
+
+        // distinct bitmaps must not share atlas space
+        int m = 0;
+        for (const ASS_Image *prev = images; prev != img; prev = prev->next, m++) {
+            const ASS_AtlasRect *r = out->rects + m;
+            if (same_key(prev, img)) {
+                if (r->atlas_x != rect->atlas_x || r->atlas_y != rect->atlas_y)
+                    return unittest_fail("%s: rectangles %d and %d of the same "
+                                         "bitmap differ", step, m, n);
+                continue;
+            }
+            if (r->atlas_x < rect->atlas_x + rect->w &&
+                    rect->atlas_x < r->atlas_x + r->w &&
+                    r->atlas_y < rect->atlas_y + rect->h &&
+                    rect->atlas_y < r->atlas_y + r->h)
+                return unittest_fail("%s: rectangles %d and %d overlap",
+                                     step, m, n);
+        }
+    }
+    if (n != out->n_rects)
+        return unittest_fail("%s: %d rectangles for %d images",
+                             step, out->n_rects, n);
+    return true;
+}
+
+static bool is_repacked(const ASS_Atlas *out)
+{
+    return out->n_updated == 1 && out->updated[0].x == 0 &&
+           out->updated[0].y == 0 && out->updated[0].w == out->w &&
+           out->updated[0].h == out->h;
+}
+
+static bool update(Atlas *atlas, ASS_Image *images, int min_width,
+                   const char *step)
+{
+    bool ok = ass_atlas_update(atlas, images, min_width);
+    if (!ok)
+        unittest_fail("%s: ass_atlas_update failed", step);
+    else
+        ok = check_atlas(atlas, images, min_width, step);
+    // the atlas keeps its own reference
+    ass_frame_unref(images);
+    return ok;
+}
+
+// Images of the previous frame keep their place, only new ones are written
+static bool check_kept_slots(Atlas *atlas, const TestBitmap *bitmaps)
+{
+    int ids1[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    ASS_Image *images = make_images(bitmaps, ids1, 10);
+    ass_frame_ref(images);
+    bool ok = update(atlas, images, MIN_WIDTH, "first frame");
+    if (ok && !is_repacked(&atlas->out))
+        ok = unittest_fail("first frame: not written as a whole");
+    int x[10], y[10];
+    for (int i = 0; ok && i < 10; i++) {
+        x[i] = atlas->out.rects[i].atlas_x;
+        y[i] = atlas->out.rects[i].atlas_y;
+    }
+    ass_frame_unref(images);
+    if (!ok)
+        return false;
+
+    // drop 8 and 9, show 3 twice, add 10 and 11 in a different order
+    int ids2[] = { 11, 7, 6, 5, 3, 4, 3, 2, 1, 10, 0 };
+    images = make_images(bitmaps, ids2, 11);
+    ass_frame_ref(images);
+    ok = update(atlas, images, MIN_WIDTH, "second frame");
+    for (int i = 0; ok && i < 11; i++) {
+        int id = ids2[i];
+        const ASS_AtlasRect *rect = atlas->out.rects + i;
+        if (id < 10 && (rect->atlas_x != x[id] || rect->atlas_y != y[id]))
+            ok = unittest_fail("second frame: bitmap %d has moved", id);
+    }
+    if (ok && atlas->out.n_updated != 2)
+        ok = unittest_fail("second frame: %d updated rectangles, expected 2",
+                           atlas->out.n_updated);
+    for (int i = 0; ok && i < 2; i++) {
+        const ASS_DirtyRect *r = atlas->out.updated + i;
+        bool found = false;
+        for (int j = 0; j < 11; j += 9) {
+            const ASS_AtlasRect *rect = atlas->out.rects + j;
+            found |= r->x == rect->atlas_x && r->y == rect->atlas_y &&
+                     r->w == rect->w && r->h == rect->h;
+        }
+        if (!found)
+            ok = unittest_fail("second frame: updated rectangle %d "
+                               "is not a new bitmap", i);
+    }
+    ass_frame_unref(images);
+    if (!ok)
+        return false;
+
+    // same bitmaps again
+    images = make_images(bitmaps, ids2, 11);
+    ok = update(atlas, images, MIN_WIDTH, "third frame");
+    if (ok && atlas->out.n_updated)
+        ok = unittest_fail("third frame: %d updated rectangles, expected none",
+                           atlas->out.n_updated);
+    return ok;
+}
+
+// Bitmaps that do not fit make the atlas grow and get packed from scratch
+static bool check_repack(Atlas *atlas, TestBitmap *bitmaps)
+{
+    int w = atlas->out.w;
+    int ids[MAX_IMAGES];
+    for (int i = 0; i < 12; i++)
+        ids[i] = i;
+
+    // wider than the atlas
+    TestBitmap *wide = bitmaps + N_BITMAPS;
+    if (!init_bitmap(wide, w + 5, 3))
+        return false;
+    ids[12] = N_BITMAPS;
+    ASS_Image *images = make_images(bitmaps, ids, 13);
+    bool ok = update(atlas, images, MIN_WIDTH, "wide bitmap");
+    if (ok && (!is_repacked(&atlas->out) || atlas->out.w <= w))
+        ok = unittest_fail("wide bitmap: atlas not widened and repacked");
+    if (!ok)
+        return false;
+
+    // taller than the atlas in total, without the wide bitmap
+    int h = atlas->out.h;
+    TestBitmap *tall = bitmaps + N_BITMAPS + 1;
+    if (!init_bitmap(tall, 8, h - 2))
+        return false;
+    ids[12] = N_BITMAPS + 1;
+    images = make_images(bitmaps, ids, 13);
+    ok = update(atlas, images, MIN_WIDTH, "tall bitmap");
+    if (ok && (!is_repacked(&atlas->out) || atlas->out.h <= h))
+        ok = unittest_fail("tall bitmap: atlas not extended and repacked");
+    if (ok && atlas->out.w < wide->w)
+        ok = unittest_fail("tall bitmap: atlas has become narrower");
+    return ok;
+}
+
+// Random changes of the displayed bitmaps, space of dropped ones is reused
+static bool check_churn(Atlas *atlas, const TestBitmap *bitmaps)
+{
+    int max_h = 0;
+    for (int frame = 0; frame < 300; frame++) {
+        int ids[MAX_IMAGES];
+        int n = rnd() % 24;
+        for (int i = 0; i < n; i++)
+            ids[i] = rnd() % N_BITMAPS;
+        ASS_Image *images = make_images(bitmaps, ids, n);
+        if (!update(atlas, images, MIN_WIDTH, "random frame"))
+            return false;
+        max_h = atlas->out.h > max_h ? atlas->out.h : max_h;
+    }
+    // all bitmaps together fit into 1024 rows of MIN_WIDTH
+    if (max_h > 1024)
+        return unittest_fail("random frames: atlas grew to %d rows", max_h);
+    return true;
+}
+
+void unittest_check_atlas(void)
+{
+    TestBitmap bitmaps[N_BITMAPS + 2] = {{0}};
+    bool ok = true;
+    for (int i = 0; ok && i < N_BITMAPS; i++)
+        ok = init_bitmap(bitmaps + i, rnd() % MAX_BITMAP_SIZE + 1,
+                         rnd() % MAX_BITMAP_SIZE + 1);
+
+    Atlas atlas = {0};
+    if (ok && check_kept_slots(&atlas, bitmaps))
+        check_repack(&atlas, bitmaps);
+    ass_atlas_done(&atlas);
+
+    Atlas atlas2 = {0};
+    if (ok)
+        check_churn(&atlas2, bitmaps);
+    ass_atlas_done(&atlas2);
+
+    for (int i = 0; i < N_BITMAPS + 2; i++)
+        free(bitmaps[i].data);
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "unittest.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Odd sizes, so that the last chroma samples cover a single column or row
+#define WIDTH 37
+#define HEIGHT 29
+#define GUARD 8             // untouched margin around every frame
+#define MAX_IMAGE_SIZE 24
+#define N_IMAGES 8
+#define N_ROUNDS 200
+
+typedef struct {
+    ASS_Image images[N_IMAGES];
+    uint8_t bitmaps[N_IMAGES][MAX_IMAGE_SIZE * (MAX_IMAGE_SIZE + 3)];
+    int n_images;
+} ImageList;
+
+/**
+ * \brief Random images, partly outside of the frame on every side
+ * and at odd and even positions
+ */
+static void make_images(ImageList *list)
+{
+    list->n_images = rnd() % N_IMAGES + 1;
+    for (int i = 0; i < list->n_images; i++) {
+        ASS_Image *img = list->images + i;
+        img->w = rnd() % MAX_IMAGE_SIZE + 1;
+        img->h = rnd() % MAX_IMAGE_SIZE + 1;
+        img->stride = img->w + rnd() % 4;
+        img->dst_x = (int) (rnd() % (WIDTH + MAX_IMAGE_SIZE)) - MAX_IMAGE_SIZE + 4;
+        img->dst_y = (int) (rnd() % (HEIGHT + MAX_IMAGE_SIZE)) - MAX_IMAGE_SIZE + 4;
+        img->type = IMAGE_TYPE_CHARACTER;
+        // include fully opaque and fully transparent colors
+        uint32_t alpha = rnd() % 3 ? rnd() & 0xFF : rnd() % 2 * 0xFF;
+        img->color = (rnd() & 0xFFFFFF00) | alpha;
+        img->bitmap = list->bitmaps[i];
+        for (int j = 0; j < img->stride * img->h; j++) {
+            // mostly empty or fully covered pixels, like real glyphs
+            uint32_t r = rnd();
+            img->bitmap[j] = r % 4 == 0 ? r >> 8 : r % 4 == 1 ? 0 : 255;
+        }
+        img->next = i + 1 < list->n_images ? img + 1 : NULL;
+    }
+}
+
+// Blending of one sample by the reference C functions
+static int blend_sample(int dst, int val, int mask, uint32_t color)
+{
+    int32_t opacity = 255 - (color & 0xFF);
+    opacity += opacity >> 7;
+    int32_t a = (mask * opacity) >> 8;
+    a += a >> 7;
+    return (dst * 256 + (val - dst) * a) >> 8;
+}
+
+static int image_mask(const ASS_Image *img, int x, int y)
+{
+    if (x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT)
+        return 0;
+    x -= img->dst_x;
+    y -= img->dst_y;
+    if (x < 0 || x >= img->w || y < 0 || y >= img->h)
+        return 0;
+    return img->bitmap[y * img->stride + x];
+}
+
+static void fill_random(uint8_t *buf, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        buf[i] = rnd();
+}
+
+static bool compare_planes(const uint8_t *res, const uint8_t *ref, int stride,
+                           int w, int h, int size, const char *name)
+{
+    // the guard margin must be left intact as well
+    for (int y = -GUARD; y < h + GUARD; y++) {
+        const uint8_t *r1 = res + (ptrdiff_t) y * stride;
+        const uint8_t *r2 = ref + (ptrdiff_t) y * stride;
+        for (int x = -GUARD * size; x < (w + GUARD) * size; x++)
+            if (r1[x] != r2[x])
+                return unittest_fail("%s: byte %d of row %d is %d, expected %d",
+                                     name, x, y, r1[x], r2[x]);
+    }
+    return true;
+}
+
+static bool check_rgba(ASS_Renderer *renderer, const ImageList *list, int flags)
+{
+    int stride = 4 * (WIDTH + 2 * GUARD) + 4 * (rnd() % 4);
+    size_t size = (size_t) stride * (HEIGHT + 2 * GUARD);
+    uint8_t *res = malloc(size), *ref = malloc(size);
+    if (!res || !ref) {
+        free(res);
+        free(ref);
+        return unittest_fail("out of memory");
+    }
+    fill_random(ref, size);
+    if (flags & ASS_BLEND_STRAIGHT) {
+        // straight alpha blending of fully transparent pixels is lossy
+        for (size_t i = 3; i < size; i += 4)
+            ref[i] |= 1;
+    }
+    memcpy(res, ref, size);
+    ptrdiff_t offset = (ptrdiff_t) GUARD * stride + 4 * GUARD;
+    ass_blend_frame_rgba(renderer, list->images, res + offset, stride,
+                         WIDTH, HEIGHT, flags);
+
+    for (int i = 0; i < list->n_images; i++) {
+        const ASS_Image *img = list->images + i;
+        uint32_t color = img->color;
+        int col[3] = { color >> 24, (color >> 16) & 0xFF, (color >> 8) & 0xFF };
+        if (flags & ASS_BLEND_BGRA) {
+            int t = col[0];
+            col[0] = col[2];
+            col[2] = t;
+        }
+        if ((color & 0xFF) == 0xFF)
+            continue;
+        for (int y = 0; y < HEIGHT; y++) {
+            for (int x = 0; x < WIDTH; x++) {
+                int mask = image_mask(img, x, y);
+                uint8_t *pix = ref + offset + (ptrdiff_t) y * stride + 4 * x;
+                if (!(flags & ASS_BLEND_STRAIGHT)) {
+                    for (int c = 0; c < 3; c++)
+                        pix[c] = blend_sample(pix[c], col[c], mask, color);
+                    pix[3] = blend_sample(pix[3], 255, mask, color);
+                    continue;
+                }
+                int32_t opacity = 255 - (color & 0xFF);
+                opacity += opacity >> 7;
+                uint32_t a = (mask * opacity) >> 8;
+                a += a >> 7;
+                if (!a)
+                    continue;
+                uint32_t w = (pix[3] * (256 - a) + 127) / 255;
+                uint32_t sum = a + w;
+                for (int c = 0; c < 3; c++)
+                    pix[c] = (col[c] * a + pix[c] * w + sum / 2) / sum;
+                pix[3] = (sum * 255 + 128) >> 8;
+            }
+        }
+    }
+
+    bool ok = compare_planes(res + offset, ref + offset, stride,
+                             WIDTH, HEIGHT, 4,
+                             flags & ASS_BLEND_STRAIGHT ? "rgba straight" :
+                             flags & ASS_BLEND_BGRA ? "bgra" : "rgba");
+    free(res);
+    free(ref);
+    return ok;
+}
+
+// Expected Y, Cb and Cr values of pure red
+static const struct {
+    ASS_YCbCrMatrix matrix;
+    int bits;
+    int yuv[3];
+} red_values[] = {
+    { YCBCR_BT601_TV,  8, {  81,  90, 240 } },
+    { YCBCR_BT601_PC,  8, {  76,  85, 255 } },
+    { YCBCR_BT709_TV,  8, {  63, 102, 240 } },
+    { YCBCR_BT709_PC,  8, {  54,  99, 255 } },
+    { YCBCR_FCC_TV,    8, {  82,  90, 240 } },
+    { YCBCR_BT601_TV, 10, { 326, 361, 960 } },
+    { YCBCR_BT709_PC, 10, { 217, 395, 1023 } },
+};
+
+static bool get_red_values(ASS_YCbCrMatrix matrix, int bits, int yuv[3])
+{
+    for (size_t i = 0; i < sizeof(red_values) / sizeof(*red_values); i++) {
+        if (red_values[i].matrix == matrix && red_values[i].bits == bits) {
+            memcpy(yuv, red_values[i].yuv, sizeof(red_values[i].yuv));
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    uint8_t *data;
+    int stride;
+    int w, h;           // in samples
+    int size;           // bytes per sample
+} Plane;
+
+static int get_sample(const Plane *p, int x, int y)
+{
+    const uint8_t *ptr = p->data + (ptrdiff_t) y * p->stride + p->size * x;
+    if (p->size == 1)
+        return *ptr;
+    uint16_t val;
+    memcpy(&val, ptr, sizeof(val));
+    return val >> 6;
+}
+
+static void set_sample(Plane *p, int x, int y, int val)
+{
+    uint8_t *ptr = p->data + (ptrdiff_t) y * p->stride + p->size * x;
+    if (p->size == 1) {
+        *ptr = val;
+        return;
+    }
+    uint16_t v = val << 6;
+    memcpy(ptr, &v, sizeof(v));
+}
+
+static bool alloc_plane(Plane *p, int w, int h, int size)
+{
+    p->w = w;
+    p->h = h;
+    p->size = size;
+    p->stride = size * (w + 2 * GUARD) + 2 * (rnd() % 4);
+    p->data = malloc((size_t) p->stride * (h + 2 * GUARD));
+    if (!p->data)
+        return unittest_fail("out of memory");
+    fill_random(p->data, (size_t) p->stride * (h + 2 * GUARD));
+    p->data += (ptrdiff_t) GUARD * p->stride + size * GUARD;
+    if (size == 2) {
+        // P010 keeps the lowest 6 bits zero
+        for (int y = -GUARD; y < h + GUARD; y++)
+            for (int x = -GUARD; x < w + GUARD; x++)
+                set_sample(p, x, y, get_sample(p, x, y));
+    }
+    return true;
+}
+
+static void free_plane(Plane *p)
+{
+    if (p->data)
+        free(p->data - (ptrdiff_t) GUARD * p->stride - p->size * GUARD);
+}
+
+static bool copy_plane(Plane *dst, const Plane *src)
+{
+    *dst = *src;
+    size_t size = (size_t) src->stride * (src->h + 2 * GUARD);
+    ptrdiff_t offset = (ptrdiff_t) GUARD * src->stride + src->size * GUARD;
+    uint8_t *data = malloc(size);
+    if (!data) {
+        dst->data = NULL;
+        return unittest_fail("out of memory");
+    }
+    memcpy(data, src->data - offset, size);
+    dst->data = data + offset;
+    return true;
+}
+
+static bool check_yuv(ASS_Renderer *renderer, ASS_Track *track,
+                      ASS_YUVFormat format, ASS_YCbCrMatrix video_matrix,
+                      ASS_YCbCrMatrix expected_matrix, const ImageList *list)
+{
+    static const char *names[] = { "i420", "nv12", "p010" };
+    int bits = format == ASS_YUV_P010 ? 10 : 8;
+    int size = bits > 8 ? 2 : 1;
+    int cw = (WIDTH + 1) / 2, ch = (HEIGHT + 1) / 2;
+    int n_planes = format == ASS_YUV_I420 ? 3 : 2;
+
+    Plane res[3] = {{0}}, ref[3] = {{0}};
+    bool ok = alloc_plane(res + 0, WIDTH, HEIGHT, size);
+    for (int i = 1; ok && i < n_planes; i++)
+        ok = alloc_plane(res + i, n_planes == 3 ? cw : 2 * cw, ch, size);
+    for (int i = 0; ok && i < n_planes; i++)
+        ok = copy_plane(ref + i, res + i);
+
+    if (ok) {
+        unsigned char *planes[3] = { res[0].data, res[1].data, res[2].data };
+        int strides[3] = { res[0].stride, res[1].stride, res[2].stride };
+        if (!ass_blend_frame_yuv(renderer, track, list->images, format,
+                                 video_matrix, planes, strides, WIDTH, HEIGHT))
+            ok = unittest_fail("%s: ass_blend_frame_yuv failed", names[format]);
+    }
+
+    // all images are red, see make_red()
+    int yuv[3];
+    if (ok && !get_red_values(expected_matrix, bits, yuv))
+        ok = unittest_fail("no reference values for matrix %d", expected_matrix);
+    for (int i = 0; ok && i < list->n_images; i++) {
+        const ASS_Image *img = list->images + i;
+        uint32_t color = img->color;
+        if ((color & 0xFF) == 0xFF)
+            continue;
+
+        for (int y = 0; y < HEIGHT; y++)
+            for (int x = 0; x < WIDTH; x++)
+                set_sample(ref, x, y, blend_sample(get_sample(ref, x, y), yuv[0],
+                                                   image_mask(img, x, y), color));
+        for (int cy = 0; cy < ch; cy++) {
+            for (int cx = 0; cx < cw; cx++) {
+                // average of the 2x2 block, outside of the frame counts as empty
+                int sum = image_mask(img, 2 * cx, 2 * cy) +
+                          image_mask(img, 2 * cx + 1, 2 * cy) +
+                          image_mask(img, 2 * cx, 2 * cy + 1) +
+                          image_mask(img, 2 * cx + 1, 2 * cy + 1);
+                int mask = (sum + 2) >> 2;
+                for (int c = 1; c < 3; c++) {
+                    Plane *p = n_planes == 3 ? ref + c : ref + 1;
+                    int px = n_planes == 3 ? cx : 2 * cx + c - 1;
+                    set_sample(p, px, cy, blend_sample(get_sample(p, px, cy),
+                                                       yuv[c], mask, color));
+                }
+            }
+        }
+    }
+
+    for (int i = 0; ok && i < n_planes; i++)
+        ok = compare_planes(res[i].data, ref[i].data, res[i].stride,
+                            res[i].w, res[i].h, size, names[format]);
+    for (int i = 0; i < n_planes; i++) {
+        free_plane(res + i);
+        free_plane(ref + i);
+    }
+    return ok;
+}
+
+// Images in pure red with random opacities, for checking the conversion
+static void make_red(ImageList *list)
+{
+    for (int i = 0; i < list->n_images; i++)
+        list->images[i].color = 0xFF000000 | (list->images[i].color & 0xFF);
+}
+
+void unittest_check_blend_frame(void)
+{
+    ASS_Renderer *renderer = ass_renderer_init(unittest_library());
+    ASS_Track *track = ass_new_track(unittest_library());
+    if (!renderer || !track) {
+        unittest_fail("out of memory");
+        goto done;
+    }
+
+    static const int rgba_flags[] = {
+        ASS_BLEND_PREMULTIPLIED,
+        ASS_BLEND_BGRA,
+        ASS_BLEND_STRAIGHT,
+        ASS_BLEND_STRAIGHT | ASS_BLEND_BGRA,
+    };
+
+    // the header of the track takes precedence unless it is None
+    static const struct {
+        bool use_track;
+        ASS_YCbCrMatrix header, video, expected;
+    } matrices[] = {
+        { true,  YCBCR_DEFAULT,  YCBCR_BT709_TV, YCBCR_BT601_TV },
+        { true,  YCBCR_UNKNOWN,  YCBCR_BT709_PC, YCBCR_BT601_TV },
+        { true,  YCBCR_NONE,     YCBCR_BT709_TV, YCBCR_BT709_TV },
+        { true,  YCBCR_NONE,     YCBCR_DEFAULT,  YCBCR_BT601_TV },
+        { true,  YCBCR_BT709_PC, YCBCR_BT601_TV, YCBCR_BT709_PC },
+        { true,  YCBCR_BT601_PC, YCBCR_NONE,     YCBCR_BT601_PC },
+        { true,  YCBCR_FCC_TV,   YCBCR_BT709_TV, YCBCR_FCC_TV },
+        { false, YCBCR_DEFAULT,  YCBCR_BT709_PC, YCBCR_BT709_PC },
+        { false, YCBCR_DEFAULT,  YCBCR_UNKNOWN,  YCBCR_BT601_TV },
+    };
+
+    ImageList *list = malloc(sizeof(ImageList));
+    if (!list) {
+        unittest_fail("out of memory");
+        goto done;
+    }
+    bool ok = true;
+    for (int round = 0; ok && round < N_ROUNDS; round++) {
+        make_images(list);
+        for (size_t i = 0; ok && i < sizeof(rgba_flags) / sizeof(*rgba_flags); i++)
+            ok = check_rgba(renderer, list, rgba_flags[i]);
+
+        make_red(list);
+        for (size_t i = 0; ok && i < sizeof(matrices) / sizeof(*matrices); i++) {
+            ASS_Track *t = NULL;
+            if (matrices[i].use_track) {
+                t = track;
+                t->YCbCrMatrix = matrices[i].header;
+            }
+            ASS_YUVFormat format = round % 3;
+            // 10-bit values are only listed for two matrices
+            if (format == ASS_YUV_P010 &&
+                    matrices[i].expected != YCBCR_BT601_TV &&
+                    matrices[i].expected != YCBCR_BT709_PC)
+                format = ASS_YUV_NV12;
+            ok = check_yuv(renderer, t, format, matrices[i].video,
+                           matrices[i].expected, list);
+        }
+    }
+    free(list);
+
+done:
+    if (track)
+        ass_free_track(track);
+    if (renderer)
+        ass_renderer_done(renderer);
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "unittest.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ass_priv.h"
+
+// Small time range and durations, so that boundaries often coincide
+#define MAX_TIME 1000
+#define MAX_DURATION 300
+#define N_ROUNDS 300
+#define N_QUERIES 64
+
+static const char header[] =
+    "[Script Info]\n"
+    "ScriptType: v4.00+\n"
+    "\n"
+    "[Events]\n"
+    "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text\n";
+
+// ass_step_sub() as a linear scan over all events
+static long long step_sub_ref(const ASS_Track *track, long long now, int movement)
+{
+    const ASS_Event *best = NULL;
+    long long target = now;
+    int direction = (movement > 0 ? 1 : -1) * !!movement;
+
+    if (track->n_events == 0)
+        return 0;
+
+    do {
+        const ASS_Event *closest = NULL;
+        long long closest_time = now;
+        for (int i = 0; i < track->n_events; i++) {
+            const ASS_Event *event = track->events + i;
+            long long time = direction < 0 ?
+                event->Start + event->Duration : event->Start;
+            bool better;
+            if (direction < 0)
+                better = time < target && (!closest || time > closest_time);
+            else if (direction > 0)
+                better = time > target && (!closest || time < closest_time);
+            else
+                better = time < target && (!closest || time >= closest_time);
+            if (better) {
+                closest = event;
+                closest_time = time;
+            }
+        }
+        target = closest_time + direction;
+        movement -= direction;
+        if (closest)
+            best = closest;
+    } while (movement);
+
+    return best ? best->Start - now : 0;
+}
+
+static long long next_change_ref(const ASS_Track *track, long long now)
+{
+    long long next = LLONG_MAX;
+    for (int i = 0; i < track->n_events; i++) {
+        long long start = track->events[i].Start;
+        long long end = start + track->events[i].Duration;
+        if (start >= end)
+            continue;
+        if (start > now && start < next)
+            next = start;
+        else if (start <= now && end > now && end < next)
+            next = end;
+    }
+    return next;
+}
+
+static bool check_active(ASS_Track *track, long long now, int round)
+{
+    EventIndex *index = &track->parser_priv->event_index;
+    if (!ass_event_index_update(index, track))
+        return unittest_fail("round %d: index update failed", round);
+
+    const int *eids;
+    int n = ass_event_index_find(index, now, &eids);
+    int k = 0;
+    for (int i = 0; i < track->n_events; i++) {
+        const ASS_Event *event = track->events + i;
+        if (event->Start > now || now >= event->Start + event->Duration)
+            continue;
+        if (k >= n || eids[k] != i)
+            return unittest_fail("round %d: active events at %lld differ "
+                                 "at position %d", round, now, k);
+        k++;
+    }
+    if (k != n)
+        return unittest_fail("round %d: %d active events at %lld, expected %d",
+                             round, n, now, k);
+    return true;
+}
+
+static bool check_queries(ASS_Track *track, int round)
+{
+    for (int i = 0; i < N_QUERIES; i++) {
+        // also query exactly at event boundaries
+        long long now = rnd() % (MAX_TIME + MAX_DURATION + 200) - 100;
+        if (track->n_events && rnd() % 2) {
+            const ASS_Event *event = track->events + rnd() % track->n_events;
+            now = event->Start + (rnd() % 2 ? event->Duration : 0);
+        }
+        int movement = (int) (rnd() % 9) - 4;
+
+        long long res = ass_step_sub(track, now, movement);
+        long long ref = step_sub_ref(track, now, movement);
+        if (res != ref)
+            return unittest_fail("round %d: ass_step_sub(%lld, %d) = %lld, "
+                                 "expected %lld", round, now, movement, res, ref);
+
+        res = ass_next_event_change(track, now);
+        ref = next_change_ref(track, now);
+        if (res != ref)
+            return unittest_fail("round %d: ass_next_event_change(%lld) = %lld, "
+                                 "expected %lld", round, now, res, ref);
+
+        if (!check_active(track, now, round))
+            return false;
+    }
+    return true;
+}
+
+static void add_events(ASS_Track *track, int count, int *read_order,
+                       long long *clock)
+{
+    // streamed events mostly arrive in order
+    bool in_order = rnd() % 2;
+    char chunk[64];
+    for (int i = 0; i < count; i++) {
+        long long start = rnd() % MAX_TIME;
+        if (in_order) {
+            *clock = (*clock + rnd() % 8) % MAX_TIME;
+            start = *clock;
+        }
+        // some events are never displayed
+        long long duration = rnd() % 8 ? rnd() % MAX_DURATION + 1 :
+                             -(long long) (rnd() % 3);
+        int size = snprintf(chunk, sizeof(chunk), "%d,0,Default,,0,0,0,,Text",
+                            (*read_order)++);
+        ass_process_chunk(track, chunk, size, start, duration);
+    }
+}
+
+static bool check_track(int round)
+{
+    ASS_Track *track = ass_new_track(unittest_library());
+    if (!track)
+        return unittest_fail("round %d: ass_new_track failed", round);
+    ass_process_codec_private(track, header, sizeof(header) - 1);
+
+    int read_order = 0;
+    long long clock = 0;
+    bool ok = true;
+    for (int step = 0; ok && step < 6; step++) {
+        // events added after the index was built are kept in its batch
+        // or merged into the tree, depending on their number
+        add_events(track, rnd() % 2 ? rnd() % 8 : rnd() % 200, &read_order, &clock);
+        ok = check_queries(track, round);
+        if (!ok)
+            break;
+
+        switch (rnd() % 4) {
+        case 0:
+            ass_prune_events(track, rnd() % (MAX_TIME + MAX_DURATION));
+            ok = check_queries(track, round);
+            break;
+        case 1:
+            if (rnd() % 4 == 0) {
+                ass_flush_events(track);
+                ok = check_queries(track, round);
+            }
+            break;
+        }
+    }
+
+    ass_free_track(track);
+    return ok;
+}
+
+void unittest_check_event_index(void)
+{
+    for (int round = 0; round < N_ROUNDS; round++)
+        check_track(round);
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "unittest.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Checks of internal code against straightforward reference implementations,
+// which don't need external samples or assembly
+
+static const struct {
+    const char *name;
+    void (*func)(void);
+} tests[] = {
+    { "event_index", unittest_check_event_index },
+    { "atlas", unittest_check_atlas },
+    { "blend_frame", unittest_check_blend_frame },
+    { 0 }
+};
+
+#define MAX_REPORTED_FAILURES 10
+
+static struct {
+    const char *test;
+    int n_failures;
+    ASS_Library *library;
+    uint32_t rand_state;
+} state;
+
+uint32_t unittest_rand(void)
+{
+    // xorshift32 from Marsaglia, George (July 2003). "Xorshift RNGs".
+    uint32_t x = state.rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return state.rand_state = x;
+}
+
+static void msg_callback(int level, const char *fmt, va_list va, void *data)
+{
+}
+
+ASS_Library *unittest_library(void)
+{
+    if (!state.library) {
+        state.library = ass_library_init();
+        if (!state.library) {
+            fprintf(stderr, "unittest: ass_library_init failed\n");
+            exit(1);
+        }
+        ass_set_message_cb(state.library, msg_callback, NULL);
+    }
+    return state.library;
+}
+
+bool unittest_fail(const char *fmt, ...)
+{
+    if (++state.n_failures > MAX_REPORTED_FAILURES)
+        return false;
+    va_list va;
+    va_start(va, fmt);
+    fprintf(stderr, "%s: ", state.test);
+    vfprintf(stderr, fmt, va);
+    fprintf(stderr, "\n");
+    va_end(va);
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *only = argc > 1 ? argv[1] : NULL;
+    int n_failed = 0;
+    for (int i = 0; tests[i].func; i++) {
+        if (only && strcmp(only, tests[i].name))
+            continue;
+        state.test = tests[i].name;
+        state.n_failures = 0;
+        state.rand_state = 0x9E3779B9;
+        tests[i].func();
+        printf("%-16s %s\n", tests[i].name, state.n_failures ? "FAILED" : "OK");
+        if (state.n_failures)
+            n_failed++;
+    }
+    if (state.library)
+        ass_library_done(state.library);
+    return n_failed ? 1 : 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2024 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef UNITTEST_UNITTEST_H
+#define UNITTEST_UNITTEST_H
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ass.h"
+
+// Deterministic pseudorandom numbers, reseeded before every test
+uint32_t unittest_rand(void);
+#define rnd unittest_rand
+
+// Library without log output, shared by all tests
+ASS_Library *unittest_library(void);
+
+// Mark the current test as failed and print the reason,
+// returns false to allow "return unittest_fail(...)"
+bool unittest_fail(const char *fmt, ...);
+
+void unittest_check_event_index(void);
+void unittest_check_atlas(void);
+void unittest_check_blend_frame(void);
+
+#endif /* UNITTEST_UNITTEST_H */